@@ -0,0 +1,56 @@
+#include <cstdlib>
+#include <new>
+
+#include "alloc_count.h"
+
+static thread_local size_t allocations = 0; // operator new calls on this thread
+
+size_t heapAllocations()
+{
+    return allocations;
+}
+
+/*
+ * count the allocation and get the memory from malloc, or from
+ * posix_memalign for over-aligned types. Return nullptr if it fails.
+ */
+static void * allocate(size_t size, size_t align)
+{
+    allocations++;
+    if (size == 0)
+        size = 1;
+    if (align <= alignof(std::max_align_t))
+        return malloc(size);
+    void * p = nullptr;
+    return posix_memalign(&p, align, size) == 0 ? p : nullptr;
+}
+
+static void * allocateOrThrow(size_t size, size_t align)
+{
+    void * p = allocate(size, align);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void * operator new(size_t size) { return allocateOrThrow(size, 0); }
+void * operator new[](size_t size) { return allocateOrThrow(size, 0); }
+void * operator new(size_t size, std::align_val_t al) { return allocateOrThrow(size, (size_t) al); }
+void * operator new[](size_t size, std::align_val_t al) { return allocateOrThrow(size, (size_t) al); }
+void * operator new(size_t size, const std::nothrow_t &) noexcept { return allocate(size, 0); }
+void * operator new[](size_t size, const std::nothrow_t &) noexcept { return allocate(size, 0); }
+void * operator new(size_t size, std::align_val_t al, const std::nothrow_t &) noexcept { return allocate(size, (size_t) al); }
+void * operator new[](size_t size, std::align_val_t al, const std::nothrow_t &) noexcept { return allocate(size, (size_t) al); }
+
+void operator delete(void * p) noexcept { free(p); }
+void operator delete[](void * p) noexcept { free(p); }
+void operator delete(void * p, size_t) noexcept { free(p); }
+void operator delete[](void * p, size_t) noexcept { free(p); }
+void operator delete(void * p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void * p, std::align_val_t) noexcept { free(p); }
+void operator delete(void * p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void * p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete(void * p, const std::nothrow_t &) noexcept { free(p); }
+void operator delete[](void * p, const std::nothrow_t &) noexcept { free(p); }
+void operator delete(void * p, std::align_val_t, const std::nothrow_t &) noexcept { free(p); }
+void operator delete[](void * p, std::align_val_t, const std::nothrow_t &) noexcept { free(p); }
@@ -0,0 +1,15 @@
+#ifndef PROJ04SRC_ALLOC_COUNT_H
+#define PROJ04SRC_ALLOC_COUNT_H
+
+#include <cstddef>
+
+/*
+ * Heap allocation counter. A program linking alloc_count.cpp replaces the
+ * global operator new and delete with versions that count every
+ * allocation made by the calling thread, at the cost of one thread-local
+ * increment. Take the count before and after a piece of code to see how
+ * often it went to the heap.
+ */
+size_t heapAllocations(); //allocations made by this thread so far
+
+#endif //PROJ04SRC_ALLOC_COUNT_H
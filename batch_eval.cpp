@@ -0,0 +1,185 @@
+#include <algorithm>
+
+#include "batch_eval.h"
+
+// The kernels use explicit SIMD where the target has it: AVX (4 doubles)
+// or SSE2 (2 doubles, always present on x86-64). Whatever does not fill a
+// whole vector, and every other target, goes through the scalar loop.
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_WIDTH 4
+typedef __m256d vec;
+static inline vec vload(const double * p) { return _mm256_loadu_pd(p); }
+static inline void vstore(double * p, vec v) { _mm256_storeu_pd(p, v); }
+static inline vec vsplat(double d) { return _mm256_set1_pd(d); }
+static inline vec vadd(vec a, vec b) { return _mm256_add_pd(a, b); }
+static inline vec vsub(vec a, vec b) { return _mm256_sub_pd(a, b); }
+static inline vec vmul(vec a, vec b) { return _mm256_mul_pd(a, b); }
+static inline vec vdiv(vec a, vec b) { return _mm256_div_pd(a, b); }
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_WIDTH 2
+typedef __m128d vec;
+static inline vec vload(const double * p) { return _mm_loadu_pd(p); }
+static inline void vstore(double * p, vec v) { _mm_storeu_pd(p, v); }
+static inline vec vsplat(double d) { return _mm_set1_pd(d); }
+static inline vec vadd(vec a, vec b) { return _mm_add_pd(a, b); }
+static inline vec vsub(vec a, vec b) { return _mm_sub_pd(a, b); }
+static inline vec vmul(vec a, vec b) { return _mm_mul_pd(a, b); }
+static inline vec vdiv(vec a, vec b) { return _mm_div_pd(a, b); }
+#endif
+
+namespace {
+
+#if defined(SIMD_WIDTH)
+struct Add {
+    static double apply(double a, double b) { return a + b; }
+    static vec apply(vec a, vec b) { return vadd(a, b); }
+};
+struct Sub {
+    static double apply(double a, double b) { return a - b; }
+    static vec apply(vec a, vec b) { return vsub(a, b); }
+};
+struct Mul {
+    static double apply(double a, double b) { return a * b; }
+    static vec apply(vec a, vec b) { return vmul(a, b); }
+};
+struct Div {
+    static double apply(double a, double b) { return a / b; }
+    static vec apply(vec a, vec b) { return vdiv(a, b); }
+};
+#else
+struct Add { static double apply(double a, double b) { return a + b; } };
+struct Sub { static double apply(double a, double b) { return a - b; } };
+struct Mul { static double apply(double a, double b) { return a * b; } };
+struct Div { static double apply(double a, double b) { return a / b; } };
+#endif
+
+/*
+ * out = a op b for the three shapes that need a loop: column-column,
+ * column-scalar and scalar-column. A scalar-scalar pair needs no loop.
+ * Every out[i] only depends on a[i] and b[i], so out may be the same
+ * buffer as a or b.
+ * Returns the data pointer of the result, or null if it is the scalar *s.
+ */
+template <typename Op>
+const double * combine(const double * a, double as, const double * b, double bs,
+                       double * out, size_t n, double * s)
+{
+    if (a == nullptr && b == nullptr) {
+        *s = Op::apply(as, bs);
+        return nullptr;
+    }
+
+    size_t i = 0;
+#if defined(SIMD_WIDTH)
+    if (a != nullptr && b != nullptr) {
+        for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH)
+            vstore(out + i, Op::apply(vload(a + i), vload(b + i)));
+    } else if (a != nullptr) {
+        vec vb = vsplat(bs);
+        for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH)
+            vstore(out + i, Op::apply(vload(a + i), vb));
+    } else {
+        vec va = vsplat(as);
+        for (; i + SIMD_WIDTH <= n; i += SIMD_WIDTH)
+            vstore(out + i, Op::apply(va, vload(b + i)));
+    }
+#endif
+    for (; i < n; i++)
+        out[i] = Op::apply(a != nullptr ? a[i] : as, b != nullptr ? b[i] : bs);
+    return out;
+}
+
+/*
+ * finish an integer division or multiplication (op is OP_IDIV or OP_IMUL):
+ * apply truncQuotient or intProduct to the n results combine wrote to
+ * out.
+ */
+void finishIntegers(Opcode op, double * out, size_t n)
+{
+    if (op == OP_IDIV) {
+        for (size_t i = 0; i < n; i++)
+            out[i] = truncQuotient(out[i]);
+    } else {
+        for (size_t i = 0; i < n; i++)
+            out[i] = intProduct(out[i]);
+    }
+}
+
+}
+
+/*
+ * evaluate prog for rows [0, rows), one batch of at most BATCH rows at a
+ * time. out must not overlap any of the columns.
+ */
+void BatchEvaluator::run(const Program & prog, const double * const * columns, size_t rows, double * out)
+{
+    if (prog.empty()) {
+        std::fill(out, out + rows, 0.0);
+        return;
+    }
+    if (scratch.size() < prog.maxStack() * BATCH)
+        scratch.resize(prog.maxStack() * BATCH);
+    if (stack.size() < prog.maxStack())
+        stack.resize(prog.maxStack());
+
+    for (size_t first = 0; first < rows; first += BATCH)
+        runBatch(prog, columns, first, std::min(BATCH, rows - first), out);
+}
+
+/*
+ * evaluate prog for the n rows starting at row first.
+ * Stack level k writes its intermediate results to scratch buffer k; the
+ * last operator writes straight into out.
+ */
+void BatchEvaluator::runBatch(const Program & prog, const double * const * columns, size_t first, size_t n,
+                              double * out)
+{
+    const double * consts = prog.consts().data();
+    size_t top = 0; // number of operands on the stack
+
+    for (const Instr * ip = prog.code().data();; ip++) {
+        switch (ip->op) {
+            case OP_VAR:
+                stack[top++] = Operand{columns[ip->arg] + first, 0.0};
+                break;
+            case OP_CONST:
+                stack[top++] = Operand{nullptr, consts[ip->arg]};
+                break;
+            case OP_ADD:
+            case OP_SUB:
+            case OP_MUL:
+            case OP_DIV:
+            case OP_IDIV:
+            case OP_IMUL: {
+                Operand b = stack[--top];
+                Operand & a = stack[top - 1];
+                double * dst = (ip[1].op == OP_RET) ? out + first : &scratch[(top - 1) * BATCH];
+                switch (ip->op) {
+                    case OP_ADD: a.data = combine<Add>(a.data, a.scalar, b.data, b.scalar, dst, n, &a.scalar); break;
+                    case OP_SUB: a.data = combine<Sub>(a.data, a.scalar, b.data, b.scalar, dst, n, &a.scalar); break;
+                    case OP_MUL:
+                    case OP_IMUL: a.data = combine<Mul>(a.data, a.scalar, b.data, b.scalar, dst, n, &a.scalar); break;
+                    default:      a.data = combine<Div>(a.data, a.scalar, b.data, b.scalar, dst, n, &a.scalar); break;
+                }
+                if (ip->op == OP_IDIV || ip->op == OP_IMUL) {
+                    if (a.data == nullptr)
+                        finishIntegers(ip->op, &a.scalar, 1);
+                    else
+                        finishIntegers(ip->op, dst, n);
+                }
+                break;
+            }
+            default: {
+                // OP_RET: make sure the result ended up in out
+                const Operand & r = stack[top - 1];
+                if (r.data == nullptr)
+                    std::fill(out + first, out + first + n, r.scalar);
+                else if (r.data != out + first)
+                    std::copy(r.data, r.data + n, out + first);
+                return;
+            }
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef PROJ04SRC_BATCH_EVAL_H
+#define PROJ04SRC_BATCH_EVAL_H
+
+#include <cstddef>
+#include <vector>
+
+#include "bytecode.h"
+
+/*
+ * Evaluates one compiled expression over many rows at a time.
+ *
+ * Every variable slot is bound to a column: a contiguous array holding
+ * the value of that variable for every row. The program is interpreted
+ * once per batch of BATCH rows instead of once per row, and each
+ * instruction runs a tight loop over the whole batch that the compiler
+ * vectorizes. Operands that are whole columns are read in place, constants
+ * stay scalars, and intermediate results go to scratch buffers that are
+ * kept between calls.
+ */
+class BatchEvaluator {
+public:
+    static constexpr size_t BATCH = 2048; // rows per batch; a few of these buffers stay in L1/L2
+
+    /*
+     * evaluate prog for rows [0, rows). Variable slot i of row r is
+     * columns[i][r]; the value of row r is written to out[r].
+     */
+    void run(const Program & prog, const double * const * columns, size_t rows, double * out);
+
+private:
+    struct Operand {
+        const double * data; // one value per row of the batch, or null for a scalar
+        double scalar;       // the value when data is null
+    };
+
+    void runBatch(const Program & prog, const double * const * columns, size_t first, size_t n, double * out);
+
+    std::vector<double> scratch;  // one BATCH sized buffer per stack level
+    std::vector<Operand> stack;   // operand stack of the batch being evaluated
+};
+
+#endif //PROJ04SRC_BATCH_EVAL_H
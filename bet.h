@@ -10,7 +10,29 @@
 #include <vector>
 #include "string.h"
 #include "token.h"
+#include "node_arena.h"
+#include "environment.h"
+#include "bytecode.h"
+#include "expr_dag.h"
+#include "expr_image.h"
+#include "optable.h"
+#include "tree_stats.h"
+#include "infix_builder.h"
 #include <algorithm>
+#include <memory>
+
+/*
+ * How much of a tree is shared with copy-on-write copies, as returned by
+ * BET::shareStats. Trees sharing nodes also share the store they are
+ * allocated from; the store counters cover all of them.
+ */
+struct ShareStats {
+    size_t treeNodes;   // nodes in the tree
+    size_t sharedNodes; // of those, nodes other trees use too
+    size_t storeNodes;  // nodes alive in the store, each counted once however many trees use it
+    size_t storeBytes;  // bytes those nodes occupy
+    long trees;         // trees allocating from the store
+};
 
 
 template <typename T>
@@ -19,51 +41,152 @@ class BET{
 
 
 public:
+    class Builder; //builds a tree one postfix token at a time
+
     BET(); //default zero-parameter constructor. Builds an empty tree.
     BET(const list<Token> & postfix); // one-parameter constructor, where parameter "postfix" is a list representing a postfix expression. The tree should be built based on the postfix expression.
-    BET(const BET&); //copy constructor -- makes appropriate deep copy of the tree
+    BET(const BET&); //copy constructor -- makes appropriate deep copy of the tree, or shares the nodes in copy-on-write mode
+    BET(BET&&) noexcept; //move constructor -- takes over the nodes in O(1), leaving the source empty
     ~BET(); //destructor -- cleans up all dynamic space in the tree
-    bool buildFromPostfix(const list<Token> & postfix); //parameter "postfix" is a list representing a postfix expression. A tree should be built based on each postfix expression. Tokens in the postfix expression are separated by spaces. If the tree contains nodes before the function is called, you need to first delete the existing nodes. Return true if the new tree is built successfully. Return false if an error is encountered.
-    const BET & operator= (const BET &); //assignment operator -- makes appropriate deep copy.
-    void printInfixExpression();// Print out the infix expression. Should do this by making use of the private (recursive) version
-    void printPostfixExpression(); //Print the postfix form of the expression. Use the private recursive function to help
-    size_t size(); //Return the number of nodes in the tree (using the private recursive function)
-    int leaves (); //Return the number of leaf nodes in the tree. (Use the private recursive function to help)
-    int depth( ); //return the depth of the tree.
-    int breadth( ); //return the breadth of the tree.
+    bool buildFromPostfix(const list<Token> & postfix, std::ostream & out = cout); //parameter "postfix" is a list representing a postfix expression. A tree should be built based on each postfix expression. Tokens in the postfix expression are separated by spaces. If the tree contains nodes before the function is called, you need to first delete the existing nodes. Return true if the new tree is built successfully. Return false, with an error message written to out, if an error is encountered.
+    bool buildFromInfix(const list<Token> & infix, std::ostream & out = cout); //build the tree from an infix expression with parentheses, such as printInfixExpression prints, in one pass (InfixBuilder). Same contract as buildFromPostfix.
+    const BET & operator= (const BET &); //assignment operator -- makes appropriate deep copy, or shares the nodes in copy-on-write mode.
+    const BET & operator= (BET &&) noexcept; //move assignment -- frees this tree and takes over the nodes of the source in O(1)
+    void swap(BET &) noexcept; //exchange two trees in O(1)
+    void printInfixExpression(std::ostream & out = cout);//Print out the infix expression to out, walking the tree with an explicit stack of frames (private version)
+    void printPostfixExpression(std::ostream & out = cout); //Print the postfix form of the expression to out, in one postorder() walk
+    size_t size(); //Return the number of nodes in the tree (from the cached statistics)
+    int leaves (); //Return the number of leaf nodes in the tree (from the cached statistics)
+    int depth( ); //return the depth of the tree (from the cached statistics)
+    int breadth( ); //return the breadth of the tree (from the cached statistics)
+    const TreeStats & stats(); //size, leaves, depth and breadth from one traversal, cached until the tree changes
+    const vector<int> & levelProfile(); //number of nodes at every depth, root first; computed and cached with stats()
     bool empty(); //return true if the tree is empty. Return false otherwise
 
     //added this one to help clear up memory
     void makeEmpty();
 
+    ArenaStats arenaStats() const; //slab and byte counters of the node arena backing this tree
+    void setCopyOnWrite(bool on); //make copies of this tree share its nodes (and copies of them too) instead of cloning them
+    bool isCopyOnWrite() const; //true if copies of this tree share its nodes
+    ShareStats shareStats(); //how many nodes of this tree are shared, and how many the shared store holds
+
+    Value evaluate(Environment & env); //compute the value of the expression, reading variables from env (0 for an empty tree)
+    size_t simplify(); //fold constant subtrees and remove identities (x+0, x*1, x*0, x-x, ...), copying only the paths above changes. Return the number of nodes eliminated.
+    uint32_t toDag(ExprDag & dag); //add the expression to dag, sharing identical subtrees. Return the id of its root (ExprDag::NONE if the tree is empty).
+    bool compile(Program & prog, Environment & env); //translate the tree into stack bytecode for VM; variables get slots of env. Return false if the tree is empty.
+    bool save(ExprImageWriter & image); //append the expression to image as one postfix expression. Return false (and add nothing) if the tree is empty.
+
 private:
+    static const int MAX_RECURSION = 1000; // deepest evaluate recurses before it switches to an explicit stack
+
     //struct created straight from book
     struct BinaryNode{
         T element;
         BinaryNode *left;
         BinaryNode *right;
+        int slot;       // variable slot in the bound Environment, -1 if the node is not a variable
+        uint32_t refs;  // links pointing to the node: parents, plus roots of trees sharing it
 
         BinaryNode(const T &theElement = T{ }, BinaryNode *lt = nullptr, BinaryNode *rt= nullptr)
-                : element{theElement}, left{lt}, right{rt} {}
+                : element{theElement}, left{lt}, right{rt}, slot{-1}, refs{1} {}
         BinaryNode(T && theElement, BinaryNode *lt = nullptr, BinaryNode *rt = nullptr)
-                : element{std::move(theElement)}, left{lt}, right{rt} {};
+                : element{std::move(theElement)}, left{lt}, right{rt}, slot{-1}, refs{1} {};
+    };
+
+    // nodes of the tree and of every copy-on-write copy of it
+    struct NodeStore {
+        NodeArena<BinaryNode> arena;
+        Lexicon names;          // long lexemes of the nodes, cleared with the arena
+        uint64_t bindEpoch = 0; // bumped whenever a tree writes variable slots into these nodes
     };
 
 
-    void printInfixExpression(BinaryNode *n); //print to the standard output the corresponding infix expression. Note that you may need to add parentheses depending on the precedence of operators. You should not have unnecessary parentheses.
+    void printInfixExpression(BinaryNode *n, std::ostream & out); //print to out the corresponding infix expression. Note that you may need to add parentheses depending on the precedence of operators. You should not have unnecessary parentheses.
     void makeEmpty(BinaryNode* &t); //delete all nodes in the subtree pointed to by t
+    template<typename Visit>
+    void postorder(BinaryNode *t, Visit visit); //call visit(node, level) on every node of the subtree pointed to by t, children first, without recursion
+    template<typename Visit>
+    void countLevels(Visit visit); //count the nodes of every level into profile, calling visit(node) on each
+    void copyFrom(const BET & t); //make this empty tree a copy of t, sharing or cloning its nodes
+    NodeArena<BinaryNode> & arena(); //the arena of the store, created on first use
+    T own(const T & e); //e with its lexeme stored in the store if e does not hold it itself
     BinaryNode * clone(BinaryNode *t); //clone all nodes in the subtree pointed to by t. Can be called by functions such as the assignment operator=.
-    void printPostfixExpression(BinaryNode *n); //print to the standard output the corresponding postfix expression.
-    size_t size(BinaryNode *t); //return the number of nodes in the subtree pointed to by t.
-    int leaves (BinaryNode *t); //return the number of leaf nodes in the subtree pointed to by t.
-    int depth(BinaryNode* &t); //return the depth of the subtree pointed to by t.
-    int breadth(BinaryNode* &t); //return the breadth of the subtree pointed to by t. Hint: this one requires a helper function for a recursive implementation. But you do not have to have a recursive implementation.
+    void printPostfixExpression(BinaryNode *n, std::ostream & out); //print to out the corresponding postfix expression.
+    void bind(BinaryNode *t, Environment & env); //resolve the variables in the subtree pointed to by t to slots of env
+    Value evaluate(BinaryNode *t, const Environment & env, int levels); //return the value of the subtree pointed to by t, recursing at most levels deep
+    Value evaluateDeep(BinaryNode *t, const Environment & env); //return the value of the subtree pointed to by t, with an explicit stack
+    void compile(BinaryNode *t, Program & prog, Environment & env); //emit the code of the subtree pointed to by t in postfix order
+    uint32_t toDag(BinaryNode *t, ExprDag & dag); //add the subtree pointed to by t to dag and return the id of its root
+    void simplify(BinaryNode* &t); //simplify the subtree pointed to by t, bottom up, rebuilding only the changed paths
+    BinaryNode * simplifyNode(BinaryNode *t); //rewrite t itself by the identities, once its children are simplified; return what replaces it
+    bool isLiteral(BinaryNode *t); //true if t is a number leaf
+    bool isLiteral(BinaryNode *t, double v); //true if t is a number leaf equal to v
+    bool equal(BinaryNode *t1, BinaryNode *t2); //true if both subtrees spell the same expression
+    BinaryNode * makeLiteral(BinaryNode *t, const Value & v); //release t and return a new number leaf holding v
+    BinaryNode * replaceWith(BinaryNode *t, BinaryNode *keep); //release t and return its child keep
     BinaryNode* root;    // Private root node is used to determine the top of the tree. A tree is empty if root ==NULL.
+    std::shared_ptr<NodeStore> store; // every node of the tree lives here; reset as a whole when the tree is cleared and shares it with no one
+    uint64_t boundEnv;   // id of the Environment the variable slots were resolved in, 0 if none
+    uint64_t bindEpoch;  // store->bindEpoch right after this tree bound its slots
+    bool copyOnWrite;    // true if copies share the nodes instead of cloning them
+    vector<BinaryNode*> path; // scratch: ancestors of the node postorder is at
+    vector<Value> values;     // scratch: operand stack of evaluate
+    vector<int> profile;      // node count of every level, valid with cachedStats
+    TreeStats cachedStats;    // result of the last stats() walk
+    bool statsValid;          // false once the tree changed since cachedStats was computed
+    int depthBound;           // depth of the tree when it was built (simplify only lowers it), -1 if empty
 
     //added these two for checking priority of  operators
-    bool priority(BinaryNode *t1, BinaryNode *t2);
-    bool priority2(BinaryNode *t1, BinaryNode *t2);
+    bool priority(BinaryNode *t1, BinaryNode *t2); //true if t2 binds looser than t1
+    bool priority2(BinaryNode *t1, BinaryNode *t2); //true if t2 needs parentheses as the right child of t1
+
+};
+
+template <typename T>
+void swap(BET<T> & a, BET<T> & b) noexcept; //exchange two trees in O(1)
+
+/*
+ * Builds a BET from a postfix expression one token at a time, so a lexer
+ * can feed the tree directly instead of collecting the line in a list
+ * first. Every push() creates the token's node at once. Errors are
+ * detected as in buildFromPostfix, whose messages finish() prints; they
+ * are held back until then, because the caller may still drop the line.
+ * A builder that is destroyed or restarted without finish() gives its
+ * nodes back.
+ *
+ * start() begins another expression with the same builder, keeping the
+ * capacity of its operand stack; together with a tree that is rebuilt in
+ * place, whose arena keeps its slabs, a line of input that is no larger
+ * than earlier ones is built without any heap allocation.
+ */
+template <typename T>
+class BET<T>::Builder {
+public:
+    Builder(); //a builder with no tree; call start() before push()
+    explicit Builder(BET & tree, std::ostream & out = cout); //empty tree and start building into it; errors go to out
+    ~Builder(); //give back the nodes if finish() was not called
+    Builder(const Builder &) = delete;
+    Builder & operator= (const Builder &) = delete;
+
+    void start(BET & tree, std::ostream & out = cout); //drop any unfinished expression, empty tree and start building into it
+    void push(const Token & tok); //add the next token of the expression; tokens after an error are ignored
+    bool finish(); //complete the tree. Return true if it was built; otherwise write the error to out, leave the tree empty and return false.
+    void abandon(); //drop the expression instead of finishing it, leaving the tree empty and printing nothing
+
+private:
+    enum Error { OK, UNPAIRED, ONE_OPERAND, OTHER };
+
+    void discard(); //give the subtrees built so far back to the arena
 
+    BET * tree;                // tree being built
+    std::ostream * out;        // where finish() reports errors
+    vector<BinaryNode*> nodes; // roots of the subtrees built so far
+    vector<int> heights;       // depth of every subtree in nodes
+    int numOperators;
+    int numOperands;
+    Error error;               // first error met, reported by finish()
+    bool finished;             // true once finish() ran, or before the first start()
 };
 
 #include "bet.hpp"
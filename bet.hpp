@@ -4,9 +4,10 @@
 
 #ifndef PROJ04SRC_BET_HPP
 #define PROJ04SRC_BET_HPP
-#include <queue>
 #include <iostream>
 #include <cstdlib>
+#include <type_traits>
+#include <memory>
 
 
 using namespace std;
@@ -21,6 +22,11 @@ template <typename T>
 BET<T>::BET()
 {
     root = nullptr;
+    boundEnv = 0;
+    bindEpoch = 0;
+    statsValid = false;
+    depthBound = -1;
+    copyOnWrite = false;
 }
 
 /*
@@ -31,16 +37,36 @@ BET<T>::BET()
 template <typename T>
 BET<T>::BET(const list<Token> & postfix){
     root = nullptr;
+    boundEnv = 0;
+    bindEpoch = 0;
+    statsValid = false;
+    depthBound = -1;
+    copyOnWrite = false;
     buildFromPostfix(postfix);
 }
 
 /*
- *  copy constructor -- makes appropriate deep copy of the tree
+ *  copy constructor -- makes appropriate deep copy of the tree,
+ *  or shares all of its nodes if t is in copy-on-write mode
  */
 template <typename T>
-BET<T>::BET(const BET&t){
-    root=  clone(t.root);
+BET<T>::BET(const BET&t)
+        : BET()
+{
+    copyOnWrite = t.copyOnWrite;
+    copyFrom(t);
+}
 
+/*
+ * move constructor -- takes over the nodes of t in O(1): the store that
+ * holds them changes hands, so no node is copied or reallocated.
+ * t is left empty.
+ */
+template <typename T>
+BET<T>::BET(BET && t) noexcept
+        : BET()
+{
+    swap(t);
 }
 
 /*
@@ -48,7 +74,7 @@ BET<T>::BET(const BET&t){
  */
 template <typename T>
 BET<T>::~BET(){
-    makeEmpty(root);
+    makeEmpty();
 }
 
 /*
@@ -57,71 +83,33 @@ BET<T>::~BET(){
  * Tokens in the postfix expression are separated by spaces.
  * If the tree contains nodes before the function is called, you need to first delete the existing nodes.
  * Return true if the new tree is built successfully.
- * Return false if an error is encountered.
+ * Return false, with an error message written to out, if an error is encountered.
  */
 template <typename T>
-bool BET<T>::buildFromPostfix(const list<Token>& postfix) {
-    // Delete existing nodes
-    makeEmpty();
-
-    // Initialize variables
-    int numOperators = 0;
-    int numOperands = 0;
-    vector<BinaryNode*> myVector;
-
-    // Iterate through each Token in the postfix expression
+bool BET<T>::buildFromPostfix(const list<Token>& postfix, std::ostream & out) {
+    // Delete existing nodes and feed every Token to a builder
+    Builder builder(*this, out);
     for (auto itr = postfix.begin(); itr != postfix.end(); itr++) {
-        if (itr->getType() == 1 || itr->getType() == 2 || itr->getType() == 3) {
-            // If the Token is an operand, create a new node and add it to the vector
-            BinaryNode* newNode = new BinaryNode(itr->getValue(), nullptr, nullptr);
-            myVector.push_back(newNode);
-            numOperands++;
-        } else {
-            // If the Token is an operator, check if there are at least two nodes in the vector
-            if (myVector.size() >= 2) {
-                // Create a new node with the operator Token's value and set its left and right children to the last two nodes in the vector
-                numOperators++;
-                BinaryNode* newNode = new BinaryNode(itr->getValue(), nullptr, nullptr);
-                newNode->right = myVector[myVector.size() - 1];
-                myVector.pop_back();
-                newNode->left = myVector[myVector.size() - 1];
-                myVector.pop_back();
-                // Add the new node to the vector
-                myVector.push_back(newNode);
-            } else {
-                // If there are not enough nodes in the vector, print an error message and return false
-                if (numOperators == numOperands) {
-                    cout << "Error: Unpaired opcode " << myVector[0]->element.getValue() << endl;
-                } else if (numOperators < numOperands) {
-                    cout << "Error: Operator " << myVector[0]->element.getValue() << " has only one operand " << endl;
-                } else {
-                    cout << "Other error " << myVector[0]->element.getValue() << endl;
-                }
-                return false;
-            }
-        }
+        builder.push(*itr);
     }
+    return builder.finish();
+}
 
-    // Check if there is exactly one node left in the vector
-    if (myVector.size() == 1) {
-        // Set the last node in the vector as the root of the tree and return true
-        root = myVector[0];
-        myVector.empty();
-        return true;
-    } else if (myVector.size() > 1) {
-        // If there are too many nodes left in the vector, print an error message and return false
-        if (numOperators == numOperands) {
-            cout << "Error: Operator " << myVector[0]->element.getValue() << " has only one operand" << endl;
-        } else if (numOperators < numOperands) {
-            cout << "Error: Unpaired opcode " << myVector[0]->element.getValue() << endl;
-        } else {
-            cout << "Other error " << myVector[0]->element.getValue() << endl;
-        }
-        return false;
-    } else {
-        // If the vector is empty, return false
-        return false;
+/*
+ * parameter "infix" is a list representing an infix expression, with
+ * parentheses where the order of operations needs them. Every node is
+ * built as soon as its operands are, without a postfix list in between;
+ * printInfixExpression prints what it reads back.
+ * Return true if the new tree is built successfully.
+ * Return false, with an error message written to out, if an error is encountered.
+ */
+template <typename T>
+bool BET<T>::buildFromInfix(const list<Token>& infix, std::ostream & out) {
+    InfixBuilder<BET> builder(*this, out);
+    for (auto itr = infix.begin(); itr != infix.end(); itr++) {
+        builder.push(*itr);
     }
+    return builder.finish();
 }
 
 /*
@@ -133,91 +121,153 @@ const BET<T> & BET<T>::operator= (const BET<T> & t){
         return *this;
 
     makeEmpty();  // clear current tree
+    copyOnWrite = t.copyOnWrite;
 
     if (t.root == nullptr)  // if rhs is empty, return empty BET
         return *this;
 
-    root = clone(t.root);  // clone rhs's tree
+    copyFrom(t);  // clone or share rhs's tree
+
+    return *this;
+}
+
+/*
+ * move assignment -- frees the current tree and takes over the nodes of t
+ * in O(1). t is left empty, holding the slabs this tree used to have.
+ */
+template <typename T>
+const BET<T> & BET<T>::operator= (BET<T> && t) noexcept
+{
+    if (this == &t)  // check for self-assignment
+        return *this;
 
+    makeEmpty();
+    swap(t);
     return *this;
 }
 
 /*
- * Print out the infix expression. Should do this by making use of the private (recursive) version
+ * exchange the trees of this and t in O(1), without touching any node.
+ */
+template <typename T>
+void BET<T>::swap(BET<T> & t) noexcept
+{
+    std::swap(root, t.root);
+    store.swap(t.store);
+    std::swap(boundEnv, t.boundEnv);
+    std::swap(bindEpoch, t.bindEpoch);
+    std::swap(copyOnWrite, t.copyOnWrite);
+    path.swap(t.path);
+    values.swap(t.values);
+    std::swap(cachedStats, t.cachedStats);
+    std::swap(statsValid, t.statsValid);
+    profile.swap(t.profile);
+    std::swap(depthBound, t.depthBound);
+}
+
+/*
+ * exchange the trees of a and b in O(1); found by std::swap callers through ADL.
  */
 template <typename T>
-void BET<T>::printInfixExpression()
+void swap(BET<T> & a, BET<T> & b) noexcept
 {
-    printInfixExpression(root);
-    cout << endl;
+    a.swap(b);
+}
+
+/*
+ * Print out the infix expression to out, through the private version,
+ * which walks the tree with an explicit stack of frames.
+ */
+template <typename T>
+void BET<T>::printInfixExpression(std::ostream & out)
+{
+    printInfixExpression(root, out);
+    out << endl;
 
 }
 
 /*
- * Print the postfix form of the expression. Use the private recursive function to help
+ * Print the postfix form of the expression to out, through the private
+ * version: one postorder() walk.
  */
 template <typename T>
-void BET<T>::printPostfixExpression()
+void BET<T>::printPostfixExpression(std::ostream & out)
 {
-    printPostfixExpression(root);
-    cout << endl;
+    printPostfixExpression(root, out);
+    out << endl;
 }
 
 /*
- * Return the number of nodes in the tree (using the private recursive function)
+ * Return the number of nodes in the tree (from the cached statistics)
  */
 template<typename T>
 size_t BET<T>::size(){
-    return size(root);
+    return stats().size;
 
 }
 
 /*
- * Return the number of leaf nodes in the tree. (Use the private recursive function to help)
+ * Return the number of leaf nodes in the tree. (from the cached statistics)
  */
 template<typename T>
 int BET<T>::leaves (){
-    return leaves(root);
+    return stats().leaves;
 }
 
 /*
- * return the depth of the tree.
+ * return the depth of the tree. (from the cached statistics)
  */
 template<typename T>
 int BET<T>::depth(){
-    return depth(root);
+    return stats().depth;
 }
 
 /*
- * return the breadth of the tree.
+ * return the breadth of the tree. (from the cached statistics)
  */
 template<typename T>
 int BET<T>::breadth() {
-    if (root == nullptr) {  // empty tree
-        return 0;
-    }
-
-    int max_breadth = 1;  // initialize the maximum breadth as 1 (i.e., the root)
-    queue<BinaryNode*> q;
-    q.push(root);
-
-    while (!q.empty()) {
-        int level_size = q.size();
-        max_breadth = std::max(max_breadth, level_size);  // update max_breadth
+    return stats().breadth;
+}
 
-        for (int i = 0; i < level_size; i++) {
-            BinaryNode* node = q.front();
-            q.pop();
-            if (node->left != nullptr) {
-                q.push(node->left);
-            }
-            if (node->right != nullptr) {
-                q.push(node->right);
-            }
+/*
+ * return the size, leaf count, depth and breadth of the tree.
+ * All four come out of a single walk, which is only done the first time
+ * they are asked for after the tree changed.
+ */
+template<typename T>
+const TreeStats & BET<T>::stats()
+{
+    if (statsValid) {
+        return cachedStats;
+    }
+    TreeStats st;
+    countLevels([&](BinaryNode *n) {
+        st.size++;
+        if (n->left == nullptr && n->right == nullptr) {
+            st.leaves++;
         }
+    });
+    st.depth = (int) profile.size() - 1;
+    for (int w : profile) {
+        st.breadth = std::max(st.breadth, w);
     }
+    cachedStats = st;
+    statsValid = true;
+    return cachedStats;
+}
 
-    return max_breadth;}
+/*
+ * return the number of nodes at every depth, the root's level first.
+ * The breadth of the tree is the largest entry. Filled by the same walk
+ * as stats() and cached with it.
+ */
+template<typename T>
+const vector<int> & BET<T>::levelProfile()
+{
+    stats();
+    return profile;
+}
 
 /*
  * return true if the tree is empty.
@@ -233,69 +283,511 @@ bool BET<T>::empty()
  * free up the memory used by all the nodes in the binary expression tree.
  * It can be used to clear the tree before building a new expression or
  * when the tree is no longer needed to avoid memory leaks.
+ * The arena keeps its slabs, so the next build reuses them.
+ * If copies share the store, only this tree's references are dropped and
+ * the tree starts over with a store of its own.
  */
 template<typename T>
 void BET<T>::makeEmpty()
 {
-    makeEmpty(root);
+    if (store != nullptr && store.use_count() > 1) {
+        makeEmpty(root);
+        store.reset();
+    } else {
+        // Node destructors only have to run when the element owns resources;
+        // otherwise the whole arena is simply rewound in O(1)
+        if (!std::is_trivially_destructible<T>::value) {
+            makeEmpty(root);
+        }
+        if (store != nullptr) {
+            store->arena.reset();
+            store->names.clear();
+        }
+    }
+    root = nullptr;
+    boundEnv = 0;
+    statsValid = false;
+    depthBound = -1;
+}
+
+/*
+ * slab and byte counters of the node arena backing this tree
+ */
+template<typename T>
+ArenaStats BET<T>::arenaStats() const
+{
+    return store != nullptr ? store->arena.stats() : ArenaStats{0, 0, 0, 0, 0};
+}
+
+/*
+ * turn copy-on-write on or off for the copies made from now on. In
+ * copy-on-write mode the copy constructor and operator= share the nodes of
+ * the source in O(1) instead of cloning them; a shared tree is never
+ * modified in place, changes copy just the nodes above them.
+ * Trees sharing nodes must be used from one thread.
+ */
+template<typename T>
+void BET<T>::setCopyOnWrite(bool on)
+{
+    copyOnWrite = on;
+}
+
+/*
+ * true if copies of this tree share its nodes
+ */
+template<typename T>
+bool BET<T>::isCopyOnWrite() const
+{
+    return copyOnWrite;
+}
+
+/*
+ * count how many nodes of the tree are shared with other trees, and how
+ * many nodes the store they all allocate from holds. A node is shared if
+ * more than one link points to it, or if it hangs below such a node.
+ */
+template<typename T>
+ShareStats BET<T>::shareStats()
+{
+    ShareStats st{size(), 0, 0, 0, 0};
+    if (root == nullptr) {
+        return st;
+    }
+    vector<pair<BinaryNode*, bool>> pending; // nodes to count, and whether an ancestor is shared
+    pending.emplace_back(root, false);
+    while (!pending.empty()) {
+        BinaryNode *n = pending.back().first;
+        bool shared = pending.back().second || n->refs > 1;
+        pending.pop_back();
+        if (shared) {
+            st.sharedNodes++;
+        }
+        if (n->left != nullptr) {
+            pending.emplace_back(n->left, shared);
+        }
+        if (n->right != nullptr) {
+            pending.emplace_back(n->right, shared);
+        }
+    }
+    ArenaStats a = store->arena.stats();
+    st.storeNodes = a.liveNodes;
+    st.storeBytes = a.liveBytes;
+    st.trees = store.use_count();
+    return st;
+}
+
+/*
+ * compute the value of the expression, reading variables from env.
+ * Variable names are resolved to slots of env the first time the tree is
+ * evaluated against it; later evaluations only index into env.
+ * An empty tree evaluates to 0.
+ */
+template<typename T>
+Value BET<T>::evaluate(Environment & env)
+{
+    if (root == nullptr) {
+        return Value();
+    }
+    // rebind if env is new to the tree, or a tree sharing its nodes bound them since
+    if (boundEnv != env.id() || bindEpoch != store->bindEpoch) {
+        bind(root, env);
+        boundEnv = env.id();
+        bindEpoch = ++store->bindEpoch;
+    }
+    return evaluate(root, env, MAX_RECURSION);
+}
+
+/*
+ * simplify the tree in place: every operator whose operands are both
+ * numbers is replaced by its value, and the identities
+ *     x + 0 = 0 + x = x - 0 = x * 1 = 1 * x = x / 1 = x
+ *     x * 0 = 0 * x = 0          x - x = 0
+ * are applied bottom up. The identities hold for finite operands; the
+ * result may change between integer and floating point (x * 0 keeps the
+ * kind of the 0 literal, x - x is the integer 0).
+ * Return the number of nodes eliminated.
+ */
+template<typename T>
+size_t BET<T>::simplify()
+{
+    if (root == nullptr) {
+        return 0;
+    }
+    size_t before = size();
+    simplify(root);
+    statsValid = false;
+    return before - size();
+}
+
+/*
+ * add the expression to dag. Subtrees that are already in the dag (from
+ * this expression or an earlier one) are not added again but shared.
+ * Return the id of its root, or ExprDag::NONE if the tree is empty.
+ */
+template<typename T>
+uint32_t BET<T>::toDag(ExprDag & dag)
+{
+    if (root == nullptr) {
+        return ExprDag::NONE;
+    }
+    return toDag(root, dag);
+}
+
+/*
+ * translate the tree into stack bytecode that VM::run can execute, with
+ * variable slot i read from vars[i] where the slots are those of env.
+ * The VM computes in doubles; a division or multiplication of two
+ * integers, where each is an integer literal, a variable env binds to an
+ * integer now (unset ones included) or a result of integers, becomes
+ * OP_IDIV or OP_IMUL and behaves like evaluate(). prog records the
+ * type it assumed for every variable: it is only valid while env.fits(prog),
+ * and must be compiled again once a variable changes type.
+ * Return false (and leave prog empty) if the tree is empty.
+ */
+template<typename T>
+bool BET<T>::compile(Program & prog, Environment & env)
+{
+    prog.clear();
+    if (root == nullptr) {
+        return false;
+    }
+    compile(root, prog, env);
+    prog.emitRet();
+    return true;
+}
+
+/*
+ * append the expression to image, token by token in postfix order, as
+ * one expression. The nodes are visited without recursion, so a tree of
+ * any depth can be saved.
+ * Return false (and add nothing) if the tree is empty.
+ */
+template<typename T>
+bool BET<T>::save(ExprImageWriter & image)
+{
+    if (root == nullptr) {
+        return false;
+    }
+    postorder(root, [&](BinaryNode *n, size_t) {
+        image.add(n->element);
+    });
+    image.endExpression();
+    return true;
+}
+
+//############## Builder ###########################
+
+/*
+ * a builder with no tree; start() gives it one.
+ */
+template <typename T>
+BET<T>::Builder::Builder()
+        : tree{nullptr}, out{&cout}, numOperators{0}, numOperands{0}, error{OK}, finished{true}
+{
+}
+
+/*
+ * empty tree and start building a new expression into it. Error
+ * messages are written to out.
+ */
+template <typename T>
+BET<T>::Builder::Builder(BET & t, std::ostream & o)
+        : Builder()
+{
+    start(t, o);
+}
+
+/*
+ * give back the nodes if finish() was not called.
+ */
+template <typename T>
+BET<T>::Builder::~Builder()
+{
+    if (!finished) {
+        discard();
+    }
+}
+
+/*
+ * drop the expression being built, if finish() was not called for it,
+ * then empty t and start building a new expression into it. The operand
+ * stack keeps its capacity.
+ */
+template <typename T>
+void BET<T>::Builder::start(BET & t, std::ostream & o)
+{
+    if (!finished) {
+        discard();
+    }
+    tree = &t;
+    out = &o;
+    nodes.clear();
+    heights.clear();
+    numOperators = 0;
+    numOperands = 0;
+    error = OK;
+    finished = false;
+    tree->makeEmpty();
+}
+
+/*
+ * add the next token of the postfix expression. An operand becomes a
+ * leaf; an operator takes the two most recent subtrees as its children.
+ * An operator with fewer than two subtrees to take is an error: it and
+ * every token after it are ignored, and finish() reports it.
+ */
+template <typename T>
+void BET<T>::Builder::push(const Token & tok)
+{
+    if (error != OK) {
+        return;
+    }
+    if (tok.getType() == SYM_NAME || tok.getType() == SYM_INTEG || tok.getType() == SYM_FLOAT) {
+        // If the Token is an operand, create a new node and add it to the vector
+        nodes.push_back(tree->arena().create(tree->own(tok), nullptr, nullptr));
+        heights.push_back(0);
+        numOperands++;
+    } else if (nodes.size() >= 2) {
+        // Create a new node with the operator Token's value and set its left and right children to the last two nodes in the vector
+        numOperators++;
+        BinaryNode* newNode = tree->arena().create(tree->own(tok), nullptr, nullptr);
+        newNode->right = nodes.back();
+        nodes.pop_back();
+        newNode->left = nodes.back();
+        nodes.pop_back();
+        // Add the new node to the vector, one level above its deeper child
+        nodes.push_back(newNode);
+        int height = 1 + std::max(heights[heights.size() - 1], heights[heights.size() - 2]);
+        heights.pop_back();
+        heights.back() = height;
+    } else if (numOperators == numOperands) {
+        error = UNPAIRED;
+    } else if (numOperators < numOperands) {
+        error = ONE_OPERAND;
+    } else {
+        error = OTHER;
+    }
+}
+
+/*
+ * complete the tree: exactly one subtree must be left, and it becomes the
+ * tree. Return true if so. Otherwise print the error message
+ * buildFromPostfix prints, give the nodes back and return false.
+ */
+template <typename T>
+bool BET<T>::Builder::finish()
+{
+    finished = true;
+    if (error == OK && nodes.size() == 1) {
+        // Set the last node in the vector as the root of the tree
+        tree->root = nodes[0];
+        tree->depthBound = heights[0];
+        nodes.clear();
+        heights.clear();
+        return true;
+    }
+
+    if (error != OK) {
+        // an operator did not find two operands
+        if (error == UNPAIRED) {
+            *out << "Error: Unpaired opcode ";
+        } else if (error == ONE_OPERAND) {
+            *out << "Error: Operator ";
+        } else {
+            *out << "Other error ";
+        }
+        if (!nodes.empty()) {
+            *out << nodes[0]->element.view();
+        }
+        if (error == ONE_OPERAND) {
+            *out << " has only one operand ";
+        }
+        *out << endl;
+    } else if (nodes.size() > 1) {
+        // If there are too many nodes left in the vector, print an error message
+        if (numOperators == numOperands) {
+            *out << "Error: Operator " << nodes[0]->element.view() << " has only one operand" << endl;
+        } else if (numOperators < numOperands) {
+            *out << "Error: Unpaired opcode " << nodes[0]->element.view() << endl;
+        } else {
+            *out << "Other error " << nodes[0]->element.view() << endl;
+        }
+    }
+    discard();
+    return false;
+}
+
+/*
+ * drop the expression being built without finishing it: the nodes go
+ * back and the tree stays empty.
+ */
+template <typename T>
+void BET<T>::Builder::abandon()
+{
+    finished = true;
+    discard();
+}
+
+/*
+ * give the subtrees built so far back to the arena.
+ */
+template <typename T>
+void BET<T>::Builder::discard()
+{
+    for (BinaryNode* node : nodes) {
+        tree->makeEmpty(node);
+    }
+    nodes.clear();
+    heights.clear();
 }
 
 //############## Private Functions ###########################
 
 /*
- * print to the standard output the corresponding infix expression.
+ * print to out the corresponding infix expression.
  * Note that you may need to add parentheses depending on the precedence of operators.
  * You should not have unnecessary parentheses.
+ *
+ * The walk keeps its own stack of frames instead of recursing, so a
+ * machine-generated chain millions of operators deep prints without
+ * overflowing the call stack. A frame goes through three phases: open its
+ * parenthesis and descend left, print its operator and descend right,
+ * close its parenthesis.
  */
 template <typename T>
-void BET<T>::printInfixExpression(BinaryNode *t){
-    if(t->left !=nullptr) // if t has a left child
-    {
-        if(priority(t,t->left)) // if the left child has higher precedence than t
-        {
-            cout<<"("; // print an opening parenthesis
-            printInfixExpression(t->left); // recursively print the left subtree in infix form
-            cout<<")"; // print a closing parenthesis
-        }
-        else // if the left child has lower or equal precedence than t
-        {
-            printInfixExpression(t->left); // recursively print the left subtree in infix form without parentheses
+void BET<T>::printInfixExpression(BinaryNode *t, std::ostream & out){
+    struct Frame {
+        BinaryNode *node;
+        int phase;
+        bool parens;  // true if the subtree is printed in parentheses
+    };
+    if (t == nullptr) {
+        return;
+    }
+    vector<Frame> frames;
+    frames.push_back(Frame{t, 0, false});
+    while (!frames.empty()) {
+        Frame &f = frames.back();
+        BinaryNode *n = f.node;
+        if (f.phase == 0) {
+            f.phase = 1;
+            if (f.parens) {
+                out << "("; // print an opening parenthesis
+            }
+            if (n->left != nullptr) { // the left child needs parentheses if it binds looser than n
+                frames.push_back(Frame{n->left, 0, priority(n, n->left)});
+            }
+        } else if (f.phase == 1) {
+            f.phase = 2;
+            out << n->element.view() << " "; // print the value of n
+            if (n->right != nullptr) { // the right child also needs them at equal precedence with left associativity
+                frames.push_back(Frame{n->right, 0, priority(n, n->right) || priority2(n, n->right)});
+            }
+        } else {
+            if (f.parens) {
+                out << ")"; // print a closing parenthesis
+            }
+            frames.pop_back();
         }
     }
-    cout << t->element.getValue() << " "; // print the value of t
-    if(t->right !=nullptr) // if t has a right child
-    {
-        if(priority(t,t->right) || priority2(t,t->right)) // if the right child has higher precedence than t, or equal precedence with right associativity
-        {
-            cout<<"("; // print an opening parenthesis
-            printInfixExpression(t->right); // recursively print the right subtree in infix form
-            cout<<")"; // print a closing parenthesis
+}
+
+/*
+ * delete all nodes in the subtree pointed to by t.
+ * A node without a left child is freed and the walk moves on to its right
+ * child; otherwise the left child is rotated up above it. Every node is
+ * freed in constant extra space, however deep the tree is.
+ * A node another link still points to is not freed but loses one
+ * reference, and the walk does not descend into it; shared nodes are
+ * never rotated.
+ */
+template<typename T>
+void BET<T>::makeEmpty(BinaryNode* &t) {
+    while (t != nullptr) {
+        if (t->refs > 1) {
+            // the rest of the subtree is still in use elsewhere
+            t->refs--;
+            t = nullptr;
+        } else if (t->left != nullptr && t->left->refs > 1) {
+            // let go of a shared left subtree instead of rotating it
+            t->left->refs--;
+            t->left = nullptr;
+        } else if (t->left != nullptr) {
+            // rotate right: the left child becomes the top of the subtree
+            BinaryNode *l = t->left;
+            t->left = l->right;
+            l->right = t;
+            t = l;
+        } else {
+            // Hand the current node t back to the arena's free list
+            BinaryNode *next = t->right;
+            store->arena.destroy(t);
+            t = next;
         }
-        else // if the right child has lower precedence than t, or equal precedence with left associativity
-        {
-            printInfixExpression(t->right); // recursively print the right subtree in infix form without parentheses
+    }
+}
+
+/*
+ * visit every node of the subtree pointed to by t in postorder, calling
+ * visit(node, level) with the level of the node (0 for t). The pending
+ * ancestors are kept in the path member, so deep trees only cost heap
+ * space, and that space is reused by the next walk. visit must not start
+ * another walk of this tree.
+ */
+template<typename T>
+template<typename Visit>
+void BET<T>::postorder(BinaryNode *t, Visit visit)
+{
+    path.clear();
+    BinaryNode *last = nullptr; // node visited most recently
+    while (t != nullptr || !path.empty()) {
+        if (t != nullptr && t->left == nullptr && t->right == nullptr) {
+            // a leaf is visited on the spot, without a trip through path
+            visit(t, path.size());
+            last = t;
+            t = nullptr;
+        } else if (t != nullptr) {
+            path.push_back(t);
+            t = t->left;
+        } else {
+            BinaryNode *top = path.back();
+            if (top->right != nullptr && top->right != last) {
+                t = top->right;
+            } else {
+                visit(top, path.size() - 1);
+                last = top;
+                path.pop_back();
+            }
         }
     }
 }
 
 /*
- * delete all nodes in the subtree pointed to by t
+ * walk the whole tree depth first, counting the nodes on every level into
+ * profile and calling visit(node) on each. The counter array and the
+ * walk's path are sized from depthBound before the walk starts, so the
+ * walk itself never allocates; levels left empty by simplify are trimmed
+ * off afterwards.
  */
 template<typename T>
-void BET<T>::makeEmpty(BinaryNode* &t) {
-    if (t != nullptr) {
-    // Recursively delete the left and right children of t
-        makeEmpty(t->left);
-        makeEmpty(t->right);
-    // Delete the current node t
-        delete t;
+template<typename Visit>
+void BET<T>::countLevels(Visit visit)
+{
+    profile.assign(depthBound + 1, 0);
+    path.reserve(depthBound + 1);
+    postorder(root, [&](BinaryNode *n, size_t level) {
+        profile[level]++;
+        visit(n);
+    });
+    while (!profile.empty() && profile.back() == 0) {
+        profile.pop_back();
     }
-    // Set the value of the given node t to nullptr
-    t = nullptr;
 }
 
 /*
  * clone all nodes in the subtree pointed to by t. Can be called by functions such as the assignment operator=.
+ * Nodes are copied in postorder; the copies of both children are then on
+ * top of the copies stack, ready to be linked under the copy of their parent.
  */
 template<typename T>
 typename BET<T>::BinaryNode * BET<T>::clone(BinaryNode *t) {
@@ -303,146 +795,372 @@ typename BET<T>::BinaryNode * BET<T>::clone(BinaryNode *t) {
     if (t == nullptr) {
         return nullptr;
     }
-    return new BinaryNode(t->element, clone(t->left), clone(t->right));
-    // The function is recursive, as it calls itself to clone the left and right children of t.
+    vector<BinaryNode*> copies;
+    postorder(t, [&](BinaryNode *n, size_t) {
+        BinaryNode *right = nullptr;
+        BinaryNode *left = nullptr;
+        if (n->right != nullptr) {
+            right = copies.back();
+            copies.pop_back();
+        }
+        if (n->left != nullptr) {
+            left = copies.back();
+            copies.pop_back();
+        }
+        BinaryNode *copy = arena().create(own(n->element), left, right);
+        copy->slot = n->slot;
+        copies.push_back(copy);
+    });
+    return copies.back();
 }
 
 /*
- * print to the standard output the corresponding postfix expression.
+ * make this empty tree a copy of the non-empty tree t: share its nodes if
+ * this tree is in copy-on-write mode, clone them otherwise.
  */
 template<typename T>
-void BET<T>::printPostfixExpression(BinaryNode *n)
+void BET<T>::copyFrom(const BET & t)
 {
-    // If the current node is not null, recursively call printPostfixExpression on the left and right children, then print the value of the node
-    if (n != nullptr) {
-        printPostfixExpression(n->left);  // recursively call printPostfixExpression on the left child
-        printPostfixExpression(n->right); // recursively call printPostfixExpression on the right child
-        cout << n->element.getValue() << " "; // print the value of the current node followed by a space
+    if (t.root == nullptr) {
+        return;
     }
+    if (copyOnWrite) {
+        // O(1): the statistics are left to be recomputed if asked for,
+        // since copying the level profile would take time in the depth
+        store = t.store;
+        root = t.root;
+        root->refs++;
+        bindEpoch = t.bindEpoch; // the shared nodes carry the slots t bound
+    } else {
+        root = clone(t.root);
+        bindEpoch = store->bindEpoch; // cloned nodes keep their variable slots
+        cachedStats = t.cachedStats; // same shape, so the same statistics
+        statsValid = t.statsValid;
+        profile = t.profile;
+    }
+    boundEnv = t.boundEnv;
+    depthBound = t.depthBound;
 }
 
 /*
- * return the number of nodes in the subtree pointed to by t.
+ * e as a node of this tree holds it: with its lexeme, unless e holds it
+ * itself, in the store of the tree, which keeps it as long as the node.
  */
 template<typename T>
-size_t BET<T>::size(BinaryNode *node){
-    // If the node is null, it has no children and the size is 0
-    if (node == nullptr) {
-        return 0;
+T BET<T>::own(const T & e)
+{
+    arena();
+    return e.storedIn(store->names);
+}
+
+/*
+ * the arena new nodes of this tree are made in, creating the store the
+ * first time a node is needed.
+ */
+template<typename T>
+NodeArena<typename BET<T>::BinaryNode> & BET<T>::arena()
+{
+    if (store == nullptr) {
+        store = std::make_shared<NodeStore>();
     }
-    // If the node is not null, its size is the size of its left subtree + size of its right subtree + 1 (for itself)
-    return 1 + size(node->left) + size(node->right);
+    return store->arena;
 }
 
 /*
- * return the number of leaf nodes in the subtree pointed to by t.
+ * print to out the corresponding postfix expression.
+ */
+template<typename T>
+void BET<T>::printPostfixExpression(BinaryNode *n, std::ostream & out)
+{
+    // print the value of every node after both of its children, followed by a space
+    postorder(n, [&out](BinaryNode *t, size_t) {
+        out << t->element.view() << " ";
+    });
+}
+
+/*
+ * resolve the variables in the subtree pointed to by t to slots of env.
  */
 template <typename T>
-int BET<T>::leaves(BinaryNode *t) {
-    // If the current node is null, it doesn't have any leaves so return 0
-    if (t == nullptr) {
-        return 0;
-    }
-    // If the current node is a leaf, it only has one leaf so return 1
+void BET<T>::bind(BinaryNode *t, Environment & env)
+{
+    postorder(t, [&](BinaryNode *n, size_t) {
+        if (n->element.getType() == SYM_NAME) {
+            n->slot = env.slot(n->element.getValue());
+        }
+    });
+}
+
+/*
+ * return the value of the subtree pointed to by t.
+ * Leaves are either a bound variable or a number parsed when its token was made;
+ * inner nodes apply their operator to the values of both children.
+ * Evaluation is the hot path, so it recurses while that is safe: once
+ * levels more levels deep, the rest of the subtree goes to evaluateDeep.
+ */
+template <typename T>
+Value BET<T>::evaluate(BinaryNode *t, const Environment & env, int levels)
+{
     if (t->left == nullptr && t->right == nullptr) {
-        return 1;
+        return t->slot >= 0 ? env.get(t->slot) : Value::of(t->element);
+    }
+    if (levels == 0) {
+        return evaluateDeep(t, env);
     }
-    // If the current node is not a leaf, then recursively find the number of leaves
-    // in the left and right subtrees and return their sum
-    return leaves(t->left) + leaves(t->right);
+    return Value::apply(t->element.getType(), evaluate(t->left, env, levels - 1), evaluate(t->right, env, levels - 1));
 }
 
 /*
- *  return the depth of the subtree pointed to by t.
- *  This function calculates the depth of the given BinaryNode 't' recursively
- *  If the BinaryNode is empty, then the depth is -1
- *  If the BinaryNode has no children, then the depth is 0
- *  Otherwise, the depth is 1 + the maximum depth of its left and right subtrees
+ * return the value of the subtree pointed to by t without recursion: in
+ * postorder the values of both children of a node are on top of the
+ * values stack.
  */
 template <typename T>
-int BET<T>::depth(BinaryNode* &t){
-    if (t == nullptr) {
-        return -1;
-    }
-    int leftDepth = depth(t->left);
-    int rightDepth = depth(t->right);
-    return 1 + std::max(leftDepth, rightDepth);
+Value BET<T>::evaluateDeep(BinaryNode *t, const Environment & env)
+{
+    values.clear();
+    postorder(t, [&](BinaryNode *n, size_t) {
+        if (n->left == nullptr && n->right == nullptr) {
+            values.push_back(n->slot >= 0 ? env.get(n->slot) : Value::of(n->element));
+            return;
+        }
+        Value r = values.back();
+        values.pop_back();
+        values.back() = Value::apply(n->element.getType(), values.back(), r);
+    });
+    return values.back();
 }
 
 /*
- * return the breadth of the subtree pointed to by t.
- * Hint: this one requires a helper function for a recursive implementation.
- * But you do not have to have a recursive implementation.
+ * emit the code of the subtree pointed to by t: the code of both children,
+ * then the operator. Postfix order is exactly stack machine order. Beside
+ * the code, a stack says which operands are integers, so that integer
+ * division and multiplication can be told apart.
  */
-template<typename T>
-int BET<T>::breadth(BinaryNode* &t) {
-    if (t == nullptr) {
-        return 0;
-    }
-    queue<BinaryNode*> q;
-    q.push(t);
-    int breadth = 0;
-    while (!q.empty()) {
-        breadth = max(breadth, (int)q.size());
+template <typename T>
+void BET<T>::compile(BinaryNode *t, Program & prog, Environment & env)
+{
+    vector<bool> integer;
+    postorder(t, [&](BinaryNode *n, size_t) {
+        if (n->left != nullptr || n->right != nullptr) {
+            bool both = integer[integer.size() - 2] && integer.back();
+            integer.pop_back();
+            integer.back() = both;
+            prog.emitOp(arithOp(n->element.getType(), both));
+        } else if (n->element.getType() == SYM_NAME) {
+            int slot = env.slot(n->element.getValue());
+            integer.push_back(env.get(slot).isInt);
+            prog.emitVar(slot, integer.back());
+        } else {
+            prog.emitConst(n->element.getNumber());
+            integer.push_back(n->element.isInteger());
+        }
+    });
+}
+
+/*
+ * add the subtree pointed to by t to dag, children first, and return the
+ * id of its root.
+ */
+template <typename T>
+uint32_t BET<T>::toDag(BinaryNode *t, ExprDag & dag)
+{
+    vector<uint32_t> ids;
+    postorder(t, [&](BinaryNode *n, size_t) {
+        if (n->left == nullptr && n->right == nullptr) {
+            ids.push_back(dag.leaf(n->element));
+            return;
+        }
+        uint32_t right = ids.back();
+        ids.pop_back();
+        ids.back() = dag.node(n->element.getType(), ids.back(), right);
+    });
+    return ids.back();
+}
 
-        for (int i = 0; i < q.size(); i++) {
-            BinaryNode* node = q.front();
-            q.pop();
+/*
+ * simplify the subtree pointed to by t, bottom up: the children are
+ * simplified first, so constants fold all the way up in one pass.
+ * The value of every subtree without variables is carried up with it, and
+ * such a subtree becomes one literal only where its value has one (see
+ * Value::hasLexeme): "5 1 6 - *" folds to nothing until "5 1 6 - * 30 +",
+ * which is 5, so the result always reads back.
+ * The subtree is rewritten rather than edited: a node whose children came
+ * back unchanged is kept, and only the nodes above a change are rebuilt.
+ * Nodes a copy-on-write copy shares are therefore never modified; the old
+ * subtree is released at the end, which frees whatever no one else uses.
+ */
+template <typename T>
+void BET<T>::simplify(BinaryNode* &t)
+{
+    vector<BinaryNode*> results; // simplified subtrees, each holding one reference
+    vector<bool> constant;       // whether each result has no variables
+    vector<Value> folded;        // and if so, its value
+    postorder(t, [&](BinaryNode *n, size_t) {
+        if (n->left == nullptr && n->right == nullptr) {
+            n->refs++;
+            results.push_back(n);
+            constant.push_back(isLiteral(n));
+            folded.push_back(isLiteral(n) ? Value::of(n->element) : Value());
+            return;
+        }
+        BinaryNode *r = results.back();
+        results.pop_back();
+        BinaryNode *l = results.back();
+        results.pop_back();
+        bool both = constant[constant.size() - 2] && constant.back();
+        Value v = both ? Value::apply(n->element.getType(), folded[folded.size() - 2], folded.back()) : Value();
+        constant.pop_back();
+        folded.pop_back();
+        BinaryNode *c;
+        if (l == n->left && r == n->right) {
+            // both children unchanged: keep n itself
+            l->refs--;
+            r->refs--;
+            n->refs++;
+            c = n;
+        } else {
+            c = arena().create(n->element, l, r);
+        }
+        c = both && v.hasLexeme() ? makeLiteral(c, v) : simplifyNode(c);
+        results.push_back(c);
+        constant.back() = both || isLiteral(c);
+        folded.back() = isLiteral(c) ? Value::of(c->element) : v;
+    });
+    BinaryNode *old = t;
+    t = results.back();
+    makeEmpty(old);
+}
 
-            if (node->left != nullptr) {
-                q.push(node->left);
+/*
+ * apply the identities to t, whose children are already simplified.
+ * Takes over the caller's reference to t and returns a reference to what
+ * replaces it (t itself if nothing applies).
+ */
+template <typename T>
+typename BET<T>::BinaryNode * BET<T>::simplifyNode(BinaryNode *t)
+{
+    BinaryNode *l = t->left;
+    BinaryNode *r = t->right;
+    switch (t->element.getType()) {
+        case SYM_ADD:
+            if (isLiteral(l, 0)) {
+                return replaceWith(t, r);
+            } else if (isLiteral(r, 0)) {
+                return replaceWith(t, l);
+            }
+            break;
+        case SYM_SUB:
+            if (isLiteral(r, 0)) {
+                return replaceWith(t, l);
+            } else if (equal(l, r)) {
+                return makeLiteral(t, Value::ofInt(0));
+            }
+            break;
+        case SYM_MUL:
+            if (isLiteral(l, 0) || isLiteral(r, 1)) {
+                return replaceWith(t, l);
+            } else if (isLiteral(r, 0) || isLiteral(l, 1)) {
+                return replaceWith(t, r);
+            }
+            break;
+        case SYM_DIV:
+            if (isLiteral(r, 1)) {
+                return replaceWith(t, l);
             }
+            break;
+    }
+    return t;
+}
+
+/*
+ * true if t is a number leaf
+ */
+template <typename T>
+bool BET<T>::isLiteral(BinaryNode *t)
+{
+    return t->left == nullptr && t->right == nullptr &&
+           (t->element.getType() == SYM_INTEG || t->element.getType() == SYM_FLOAT);
+}
+
+/*
+ * true if t is a number leaf equal to v
+ */
+template <typename T>
+bool BET<T>::isLiteral(BinaryNode *t, double v)
+{
+    return isLiteral(t) && t->element.getNumber() == v;
+}
 
-            if (node->right != nullptr) {
-                q.push(node->right);
+/*
+ * true if both subtrees spell the same expression
+ */
+template <typename T>
+bool BET<T>::equal(BinaryNode *t1, BinaryNode *t2)
+{
+    vector<pair<BinaryNode*, BinaryNode*>> pending; // pairs of subtrees still to compare
+    pending.emplace_back(t1, t2);
+    while (!pending.empty()) {
+        BinaryNode *a = pending.back().first;
+        BinaryNode *b = pending.back().second;
+        pending.pop_back();
+        if (a == nullptr || b == nullptr) {
+            if (a != b) {
+                return false;
             }
+            continue;
         }
+        if (!a->element.sameLexeme(b->element)) {
+            return false;
+        }
+        pending.emplace_back(a->left, b->left);
+        pending.emplace_back(a->right, b->right);
     }
-    return breadth;
+    return true;
 }
 
 /*
- * This function returns true if the operator in t1
- * has higher precedence than the operator in t2, and false otherwise.
- *
- * The function checks whether the operator in t1 is either multiplication (*)
- * or division (/) and the operator in t2 is either addition (+) or subtraction (-).
- * If both conditions are true, it means that the operator in t1 has
- * higher precedence than the operator in t2, and the function returns true.
- * Otherwise, it returns false.
+ * release t and return a new number leaf holding v
  */
 template <typename T>
-bool BET<T>::priority(BinaryNode *t1, BinaryNode *t2)
+typename BET<T>::BinaryNode * BET<T>::makeLiteral(BinaryNode *t, const Value & v)
 {
-    return (t1->element.getValue() == "*" || t1->element.getValue() == "/") && (t2->element.getValue() == "+" || t2->element.getValue() == "-");
+    makeEmpty(t);
+    string text = v.lexeme();
+    return arena().create(own(T(std::string_view(text), v.isInt ? SYM_INTEG : SYM_FLOAT)), nullptr, nullptr);
+}
 
+/*
+ * release t and return its child keep, which survives t
+ */
+template <typename T>
+typename BET<T>::BinaryNode * BET<T>::replaceWith(BinaryNode *t, BinaryNode *keep)
+{
+    keep->refs++;
+    makeEmpty(t);
+    return keep;
 }
 
 /*
- * This code checks whether the two nodes have the same value first,
- * and then uses a switch statement to check the cases where t1 is either
- * '+' or '-', and t2 is the opposite operator. If either of these cases
- * is true, the function returns true. Otherwise, it returns false.
+ * true if t2 binds looser than t1, i.e. t2 needs parentheses as either
+ * child of t1. Precedences come from OP_TABLE, indexed by token class;
+ * operands bind tightest, so a leaf never needs them.
+ */
+template <typename T>
+bool BET<T>::priority(BinaryNode *t1, BinaryNode *t2)
+{
+    return precedence(t2->element.getType()) < precedence(t1->element.getType());
+}
+
+/*
+ * true if t2, as the right child of t1, needs parentheses although both
+ * bind equally tight: t1 groups to the left, so "a - (b + c)" and
+ * "a / (b * c)" must keep theirs.
  */
 template <typename T>
 bool BET<T>::priority2(BinaryNode *t1, BinaryNode *t2)
 {
-    if (t1->element.getValue() == t2->element.getValue()) {
-        return true;
-    }
-    switch (t1->element.getValue()[0]) {
-        case '+':
-            if (t2->element.getValue()[0] == '-') {
-                return true;
-            }
-            break;
-        case '-':
-            if (t2->element.getValue()[0] == '+') {
-                return true;
-            }
-            break;
-    }
-    return false;
+    return needsParens(t1->element.getType(), t2->element.getType(), true);
 }
 
 
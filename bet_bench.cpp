@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <list>
+#include <streambuf>
+#include <vector>
+
+#include "opnum.h"
+#include "lexer.h"
+#include "mapped_file.h"
+#include "token.h"
+#include "bet.h"
+#include "flat_bet.h"
+#include "parse_context.h"
+
+using namespace std;
+
+/* Times every phase bet_driver goes through on the expressions of the
+ * input (typically written by bet_gen):
+ *   lex            tokenize the whole input with a Lexer
+ *   lex+builder    tokenize it and stream the tokens into a ParseContext
+ *   build          buildFromPostfix from a list<Token> per line
+ *   stats          size, leaves, depth and breadth of freshly built
+ *                  trees, which all come out of the one walk stats()
+ *                  makes and caches
+ *   clone          copy-construct every tree
+ *   print infix, print postfix
+ *                  print every tree to a stream that discards it
+ * Each phase runs over all expressions, once to warm up and then -r times
+ * (10 by default). The minimum, median, mean and standard deviation over
+ * the runs are reported in nanoseconds per node.
+ * -f benchmarks FlatBET instead of BET. */
+
+/* Swallows everything written to it. */
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char *, streamsize n) override { return n; }
+};
+
+/* Input held in memory: mapped if it is a file, read otherwise. */
+struct Input {
+    MappedFile mapped;
+    vector<char> text;
+    const char * begin = nullptr;
+    const char * end = nullptr;
+};
+
+static void load(const char * path, Input & in)
+{
+    if (path != nullptr && in.mapped.open(path)) {
+        in.begin = in.mapped.begin();
+        in.end = in.mapped.end();
+        return;
+    }
+    FILE * f = path != nullptr ? fopen(path, "r") : stdin;
+    if (f == nullptr) {
+        f = stdin;
+    }
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        in.text.insert(in.text.end(), buf, buf + n);
+    }
+    if (f != stdin) {
+        fclose(f);
+    }
+    in.begin = in.text.data();
+    in.end = in.begin + in.text.size();
+}
+
+/* Times of all runs of one phase, in ns per node. */
+static void summarize(const char * phase, vector<double> & ns)
+{
+    sort(ns.begin(), ns.end());
+    double mean = 0;
+    for (double t : ns) {
+        mean += t;
+    }
+    mean /= ns.size();
+    double var = 0;
+    for (double t : ns) {
+        var += (t - mean) * (t - mean);
+    }
+    double sd = ns.size() > 1 ? sqrt(var / (ns.size() - 1)) : 0;
+    size_t mid = ns.size() / 2;
+    double median = ns.size() % 2 ? ns[mid] : (ns[mid - 1] + ns[mid]) / 2;
+    cout << "  " << left << setw(14) << phase << right << fixed << setprecision(2)
+         << setw(10) << ns.front() << setw(10) << median
+         << setw(10) << mean << setw(10) << sd
+         << defaultfloat << setprecision(6) << endl;
+}
+
+/* Runs prepare() untimed and then body() timed, runs + 1 times, and
+ * reports all but the first in ns per node. */
+template <typename Prepare, typename Body>
+static void phase(const char * name, int runs, size_t nodes, Prepare prepare, Body body)
+{
+    vector<double> ns;
+    for (int r = 0; r <= runs; r++) {
+        prepare();
+        auto start = chrono::steady_clock::now();
+        body();
+        double t = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+        if (r > 0) {
+            ns.push_back(t / (nodes ? nodes : 1));
+        }
+    }
+    summarize(name, ns);
+}
+
+template <typename Tree>
+static int bench(const Input & in, int runs)
+{
+    // every line as the token list buildFromPostfix takes
+    vector<list<Token> > lines;
+    {
+        Lexer lex(in.begin, in.end);
+        list<Token> line;
+        int cls;
+        do {
+            cls = lex.next();
+            if (cls > SYM_NULL && cls < SYM_ENDLN) {
+                line.push_back(Token(lex.lexeme(), cls)); // long lexemes point into in, which outlives the lines
+            } else if (cls >= SYM_INVAL) {
+                cerr << "invalid token " << lex.lexeme() << " at offset " << lex.offset() << endl;
+                return 1;
+            } else if (!line.empty()) {
+                lines.push_back(std::move(line));
+                line.clear();
+            }
+        } while (cls > SYM_NULL);
+    }
+
+    vector<Tree> trees(lines.size());
+    size_t nodes = 0;
+    for (size_t i = 0; i < lines.size(); i++) {
+        if (!trees[i].buildFromPostfix(lines[i])) {
+            return 1;
+        }
+        nodes += trees[i].size();
+    }
+    cout << lines.size() << " expressions, " << nodes << " nodes, " << runs << " runs" << endl;
+    cout << "  " << left << setw(14) << "ns/node" << right
+         << setw(10) << "min" << setw(10) << "median" << setw(10) << "mean" << setw(10) << "stddev" << endl;
+
+    auto nothing = [] { };
+    auto rebuild = [&] {
+        for (size_t i = 0; i < lines.size(); i++) {
+            trees[i].buildFromPostfix(lines[i]);
+        }
+    };
+    volatile long sink = 0;
+
+    phase("lex", runs, nodes, nothing, [&] {
+        Lexer lex(in.begin, in.end);
+        long tokens = 0;
+        while (lex.next() > SYM_NULL) {
+            tokens++;
+        }
+        sink = tokens;
+    });
+    phase("lex+builder", runs, nodes, nothing, [&] {
+        Lexer lex(in.begin, in.end);
+        ParseContext<Tree> ctx;
+        int cls = SYM_ENDLN;
+        while (cls > SYM_NULL) {
+            typename Tree::Builder & builder = ctx.start();
+            while ((cls = lex.next()) > SYM_NULL && cls != SYM_ENDLN) {
+                builder.push(Token(lex.lexeme(), cls));
+            }
+            sink = builder.finish();
+        }
+    });
+    phase("build", runs, nodes, nothing, rebuild);
+    phase("stats", runs, nodes, rebuild, [&] {
+        for (Tree & t : trees) sink = t.stats().breadth;
+    });
+
+    vector<Tree> copies;
+    copies.reserve(trees.size());
+    phase("clone", runs, nodes, [&] { copies.clear(); }, [&] {
+        for (Tree & t : trees) copies.emplace_back(t);
+    });
+    copies.clear();
+
+    NullBuffer discard;
+    ostream null(&discard);
+    phase("print infix", runs, nodes, nothing, [&] {
+        for (Tree & t : trees) t.printInfixExpression(null);
+    });
+    phase("print postfix", runs, nodes, nothing, [&] {
+        for (Tree & t : trees) t.printPostfixExpression(null);
+    });
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    int runs = 10;
+    bool flat = false;
+
+    // options come before the input file, as in bet_driver
+    while (argc > 1 && argv[1][0] == '-' && argv[1][1] != '\0') {
+        if (strcmp(argv[1], "-r") == 0 && argc > 2 && atoi(argv[2]) > 0) {
+            runs = atoi(argv[2]);
+            argv[1] = argv[0];
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "-f") == 0) {
+            flat = true;
+        } else {
+            cerr << "usage: " << argv[0] << " [-f] [-r runs] [file]" << endl;
+            return 1;
+        }
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+
+    Input in;
+    load(argc > 1 ? argv[1] : nullptr, in);
+    return flat ? bench<FlatBET>(in, runs) : bench<BET<Token> >(in, runs);
+}
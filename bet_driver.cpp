@@ -1,30 +1,61 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <list>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "opnum.h"
+#include "lexer.h"
+#include "char_scan.h"
+#include "mapped_file.h"
 #include "token.h"
 #include "bet.h"
+#include "flat_bet.h"
+#include "environment.h"
+#include "work_pool.h"
+#include "parse_context.h"
+#include "infix_builder.h"
+#include "alloc_count.h"
+#include "phase_stats.h"
+#include "expr_image.h"
 
 using namespace std;
 
-/* This function uses the interface from opnum.h.
- * It extracts tokens from one line of input, and inserts 
- * them to a list.  If there are some incorrect token, 
- * it reports the total number accordingly. */
-int get_postfix(std::list<Token> & postfix, int * ret)
+/* This function reads tokens from the lexer.
+ * It extracts tokens from one line of input, and feeds 
+ * them to the tree builder, counting them in *tokens.  If there are some incorrect token, 
+ * it reports the total number accordingly. Invalid tokens are echoed to out.
+ * Parentheses, which an infix lexer returns, are counted in *tokens and
+ * also in *parens.
+ * Lexing and building are timed on clock. */
+template <typename Builder>
+int get_postfix(Lexer & lex, Builder & builder, size_t * tokens, size_t * parens, int * ret, ostream & out, PhaseClock & clock)
 {
     int num = 0;
     int retval = 0;
     do {
-        char * opnum = get_opnum(&retval);
+        PHASE(clock, PHASE_LEX);
+        retval = lex.next();
         if (retval) {
-            string str = opnum;
-            Token nt (str, retval);
-
-            if (retval >= SYM_INVAL) {
-                cout<< opnum << endl;
+            if (retval == SYM_INVAL) {
+                PHASE(clock, PHASE_PRINT);
+                out << lex.lexeme() << endl;
                 num ++;
-            } else if (retval < SYM_ENDLN) {
-                postfix.push_back(nt);
+            } else if (retval != SYM_ENDLN) {
+                PHASE(clock, PHASE_BUILD);
+                builder.push(Token(lex.lexeme(), retval));
+                (*tokens)++;
+                (*parens) += (retval > SYM_INVAL);
             }
         }
     } while (retval > SYM_NULL && retval != SYM_ENDLN);
@@ -34,64 +65,657 @@ int get_postfix(std::list<Token> & postfix, int * ret)
     return num;
 }
 
+/* Counts added up over all lines. */
+struct Totals {
+    size_t nodesBuilt = 0;      // -s: nodes in all trees before simplification
+    size_t nodesEliminated = 0; // -s: nodes removed from all trees
+    size_t lines = 0;           // -a: lines with tokens parsed into trees
+    size_t allocations = 0;     // -a: heap allocations made while lexing and building them
+    size_t allocatingLines = 0; // -a: lines whose parsing allocated at all
+    PhaseStats phases;          // --stats: time spent in every phase, and the counters
 
-int main(int argc, char ** argv)
+    void add(const Totals & t)
+    {
+        nodesBuilt += t.nodesBuilt;
+        nodesEliminated += t.nodesEliminated;
+        lines += t.lines;
+        allocations += t.allocations;
+        allocatingLines += t.allocatingLines;
+        phases.add(t.phases);
+    }
+};
+
+/* Settings taken from the command line. */
+struct Options {
+    bool flat = false;          // -f: use the flat, index-based tree layout
+    bool eval = false;          // -e: print the value of every expression
+    bool simplify = false;      // -s: simplify every tree before reporting it
+    bool dag = false;           // -d: report the size of the tree with common subexpressions shared
+    bool profile = false;       // -p: print the number of nodes at every depth
+    bool cow = false;           // -c: copies share nodes (copy-on-write); report how many
+    bool allocs = false;        // -a: count the heap allocations made while parsing
+    bool infix = false;         // -i: the expressions are written in infix, with parentheses
+    unsigned jobs = 0;          // -j N: build and report on N threads, 0 to run sequentially
+    bool stats = false;         // --stats: time the phases and report them at exit
+    bool statsJson = false;     // --stats=json: ... as JSON rather than text
+    const char * saveTo = nullptr; // -o file: save every correctly built tree to file as an expression image
+    bool image = false;         // -b: the input file is an expression image saved with -o
+    ExprImageWriter saved;      // -o: the trees saved so far
+    Environment env;            // -D name=value bindings used by -e
+    Totals totals;              // counts over all lines reported on so far
+};
+
+/* Heap allocations this thread has made so far, for -a. The counting
+ * operator new of alloc_count.cpp is only linked in with BET_STATS, so
+ * without it nothing is counted. */
+static size_t allocationsSoFar()
 {
-    int ret = 0;
-    std::list<Token> postfix;
+#if BET_STATS
+    return heapAllocations();
+#else
+    return 0;
+#endif
+}
+
+void usage(const char * prog)
+{
+    cerr << "usage: " << prog << " [--stats[=json]] [-j threads | -o image | -b] [-a] [-i] [-p] [-f | [-c] [-s] [-d] [-e [-D name=value]...]] [file]" << endl;
+}
+
+/* Simplifies the tree and reports how many nodes went away.
+ * Only BET can be simplified, shared or evaluated; the FlatBET overloads
+ * are never reached because -f is rejected together with -c, -s, -d and -e. */
+void simplify_tree(BET<Token> & bet, Options & opt, ostream & out)
+{
+    size_t before = bet.size();
+    size_t eliminated = bet.simplify();
+    opt.totals.nodesBuilt += before;
+    opt.totals.nodesEliminated += eliminated;
+    out << "Nodes eliminated by simplification: " << eliminated << endl;
+}
+
+void simplify_tree(FlatBET &, Options &, ostream &)
+{
+}
+
+/* Prints the size of the tree next to the size of its DAG, in which
+ * common subexpressions are stored once. */
+void print_dag(BET<Token> & bet, ostream & out)
+{
+    ExprDag dag;
+    uint32_t root = bet.toDag(dag);
+    out << "Tree size: " << dag.treeSize(root) << ", DAG size: " << dag.size() << endl;
+}
+
+void print_dag(FlatBET &, ostream &)
+{
+}
+
+/* Turns on copy-on-write, so the copies made by report share the nodes. */
+void share_copies(BET<Token> & bet)
+{
+    bet.setCopyOnWrite(true);
+}
+
+void share_copies(FlatBET &)
+{
+}
+
+/* Prints how many nodes of the tree its copies share and what the
+ * store they all allocate from holds. */
+void print_sharing(BET<Token> & bet, ostream & out)
+{
+    ShareStats st = bet.shareStats();
+    out << "Shared nodes: " << st.sharedNodes << " of " << st.treeNodes
+         << ", store holds " << st.storeNodes << " nodes (" << st.storeBytes
+         << " bytes) for " << st.trees << " trees" << endl;
+}
+
+void print_sharing(FlatBET &, ostream &)
+{
+}
+
+/* Prints the value of the expression with the variables bound by -D. */
+void print_value(BET<Token> & bet, Options & opt, ostream & out)
+{
+    out << "Value of expression: " << bet.evaluate(opt.env) << endl;
+}
+
+void print_value(FlatBET &, Options &, ostream &)
+{
+}
+
+// trees are moved, not deep-copied, when a vector of them grows
+static_assert(std::is_nothrow_move_constructible<BET<Token> >::value &&
+              std::is_nothrow_move_constructible<FlatBET>::value,
+              "trees must be nothrow movable");
+
+/* Prints the expressions and statistics of the tree just built from
+ * one line (correct is false if building it failed), then exercises the
+ * copy constructor, the assignment operator and their moving counterparts.
+ * Everything is printed to out; the time goes to the phases on clock.
+ * Tree is BET<Token> or FlatBET. */
+template <typename Tree>
+void report(Tree & bet, bool correct, Options & opt, ostream & out, PhaseClock & clock)
+{
+    // the tree as it was built, before it is simplified
+    if (correct && opt.saveTo != nullptr) {
+        bet.save(opt.saved);
+    }
+
+    if (correct && opt.simplify) {
+        PHASE(clock, PHASE_SIMPLIFY);
+        simplify_tree(bet, opt, out);
+    }
 
-    set_input(argc, argv);
+    if (opt.cow) {
+        share_copies(bet);
+    }
+
+    PHASE(clock, PHASE_PRINT);
+    if (!correct) {
+        out << "Incorrect construction from postfix ...\n" << endl;
+    } else if (!bet.empty()) {
+        out << "Postfix expression: ";
+        bet.printPostfixExpression(out);
+
+        out << "Infix expression: ";
+        bet.printInfixExpression(out);
+
+        // one traversal for all four statistics
+        PHASE(clock, PHASE_STATS);
+        const TreeStats & st = bet.stats();
+
+        PHASE(clock, PHASE_PRINT);
+        out << "Number of nodes: ";
+        out << st.size << endl;
+
+        out << "Number of leaf nodes: ";
+        out << st.leaves << endl;
+
+        out << "Depth of tree: ";
+        out << st.depth << endl;
+
+        out << "Breadth of tree: ";
+        out << st.breadth << endl;
+
+        if (opt.profile) {
+            PHASE(clock, PHASE_STATS);
+            vector<int> profile = bet.levelProfile();
+            PHASE(clock, PHASE_PRINT);
+            out << "Nodes per level:";
+            for (int count : profile) {
+                out << " " << count;
+            }
+            out << endl;
+        }
+
+        // building the DAG and evaluating count as statistics, printing included
+        if (opt.dag) {
+            PHASE(clock, PHASE_STATS);
+            print_dag(bet, out);
+        }
+
+        if (opt.eval) {
+            PHASE(clock, PHASE_STATS);
+            print_value(bet, opt, out);
+        }
+
+        // test copy constructor
+        PHASE(clock, PHASE_COPY);
+        Tree bet2(bet);
+        PHASE(clock, PHASE_PRINT);
+        out << "Testing copy constructor: ";
+        bet2.printInfixExpression(out);
+
+        // test assignment operator
+        PHASE(clock, PHASE_COPY);
+        Tree bet3;
+        bet3 = bet;
+        PHASE(clock, PHASE_PRINT);
+        out << "Testing assignment operator: ";
+        bet3.printInfixExpression(out);
+
+        if (opt.cow) {
+            print_sharing(bet, out);
+        }
+
+        // test move constructor: takes over the nodes of bet2 without copying them
+        PHASE(clock, PHASE_COPY);
+        Tree bet4(std::move(bet2));
+        PHASE(clock, PHASE_PRINT);
+        out << "Testing move constructor: ";
+        bet4.printInfixExpression(out);
+
+        // test move assignment: bet3 is left empty
+        PHASE(clock, PHASE_COPY);
+        Tree bet5;
+        bet5 = std::move(bet3);
+        PHASE(clock, PHASE_PRINT);
+        out << "Testing move assignment: ";
+        bet5.printInfixExpression(out);
+
+        // the trees go away here, and that is copying too
+        PHASE(clock, PHASE_COPY);
+    }
+}
+
+/* Prints the correct tokens of a line the way a list<Token> prints,
+ * lexing its text again rather than keeping the tokens around.
+ * Parentheses are correct if infix is true. */
+void print_tokens(std::string_view line, ostream & out, bool infix)
+{
+    Lexer again(line.data(), line.data() + line.size());
+    again.setInfix(infix);
+    int cls;
+    while ((cls = again.next()) > SYM_NULL) {
+        if (cls < SYM_ENDLN || cls > SYM_INVAL) {
+            out << again.lexeme() << ' ';
+        }
+    }
+}
+
+/* process() for one kind of tree and notation: every line is streamed
+ * from the lexer straight into the builder of a ParseContext, which keeps
+ * the tree and the builder from one line to the next. With --stats the
+ * phases are timed into opt.totals.phases.
+ * Builder is Tree::Builder for postfix or InfixBuilder<Tree> for infix. */
+template <typename Tree, typename Builder>
+bool process_lines(Lexer & lex, Options & opt, ostream & out)
+{
+    int ret = 0;
+    ParseContext<Tree, Builder> ctx;
+    PhaseClock clock(BET_STATS && opt.stats ? &opt.totals.phases : nullptr);
 
     do {
-        int num = get_postfix(postfix, &ret);
+        size_t allocations = allocationsSoFar();
+        PHASE(clock, PHASE_BUILD);
+        Builder & builder = ctx.start(out);
+        size_t tokens = 0;
+        size_t parens = 0;
+        int num = get_postfix(lex, builder, &tokens, &parens, &ret, out, clock);
+        PHASE_ADD(opt.totals.phases, COUNT_TOKENS, tokens);
         if (num) {
-            cout << num << " incorrect tokens found. "<<endl << postfix <<endl;
-            postfix.clear();
+            PHASE(clock, PHASE_PRINT);
+            out << num << " incorrect tokens found. "<<endl;
+            print_tokens(lex.line(), out, opt.infix);
+            out << endl;
+            return false;
+        }
+
+        if (tokens > 0) {
+            PHASE(clock, PHASE_BUILD);
+            bool correct = builder.finish();
+            allocations = allocationsSoFar() - allocations;
+            opt.totals.lines++;
+            opt.totals.allocations += allocations;
+            opt.totals.allocatingLines += (allocations > 0);
+            PHASE_ADD(opt.totals.phases, COUNT_LINES, 1);
+            PHASE_ADD(opt.totals.phases, COUNT_NODES, correct ? tokens - parens : 0); // a node per token but parentheses
+            report(ctx.tree(), correct, opt, out, clock);
+            PHASE(clock, PHASE_PRINT);
+            out << "Terminating one postfix expression ...\n" << endl;
+        }
+    } while (ret > SYM_NULL);
+
+    return true;
+}
+
+/* Reports on every expression the lexer reads, printing to out, and adds
+ * the simplification counts to opt. Stops at the first line with incorrect
+ * tokens and returns false; returns true at the end of the input. */
+bool process(Lexer & lex, Options & opt, ostream & out)
+{
+#if BET_STATS
+    size_t allocations = heapAllocations();
+#endif
+    bool ok;
+    lex.setInfix(opt.infix);
+    if (opt.flat) {
+        ok = opt.infix ? process_lines<FlatBET, InfixBuilder<FlatBET> >(lex, opt, out)
+                       : process_lines<FlatBET, FlatBET::Builder>(lex, opt, out);
+    } else {
+        ok = opt.infix ? process_lines<BET<Token>, InfixBuilder<BET<Token> > >(lex, opt, out)
+                       : process_lines<BET<Token>, BET<Token>::Builder>(lex, opt, out);
+    }
+    PHASE_ADD(opt.totals.phases, COUNT_ALLOCATIONS, heapAllocations() - allocations);
+    return ok;
+}
+
+/* Reports on every expression of an image saved with -o, as process()
+ * reports on the lines they were built from: each one is fed from the
+ * mapping straight into the builder, with nothing to lex. Mapping and
+ * checking the image is timed as lexing. Returns false, with the reason
+ * on cerr, if path is not a valid image. */
+template <typename Tree>
+bool process_image(const char * path, Options & opt, ostream & out)
+{
+    ParseContext<Tree> ctx;
+    PhaseClock clock(BET_STATS && opt.stats ? &opt.totals.phases : nullptr);
+    ExprImage image;
+    string error;
+
+    PHASE(clock, PHASE_LEX);
+    if (!image.open(path, error)) {
+        cerr << path << ": " << error << endl;
+        return false;
+    }
+
+    for (size_t e = 0; e < image.size(); e++) {
+        size_t allocations = allocationsSoFar();
+        PHASE(clock, PHASE_BUILD);
+        typename Tree::Builder & builder = ctx.start(out);
+        image.build(e, builder);
+        bool correct = builder.finish();
+        allocations = allocationsSoFar() - allocations;
+        opt.totals.lines++;
+        opt.totals.allocations += allocations;
+        opt.totals.allocatingLines += (allocations > 0);
+        PHASE_ADD(opt.totals.phases, COUNT_LINES, 1);
+        PHASE_ADD(opt.totals.phases, COUNT_NODES, correct ? image.length(e) : 0);
+        PHASE_ADD(opt.totals.phases, COUNT_TOKENS, image.length(e));
+        report(ctx.tree(), correct, opt, out, clock);
+        PHASE(clock, PHASE_PRINT);
+        out << "Terminating one postfix expression ...\n" << endl;
+    }
+    return true;
+}
+
+/* Returns the end of the chunk of lines that starts at begin and is
+ * about size bytes long. A chunk ends just after a run of line ends, at
+ * a place where the lexer ends a line too: not after a line with a "//"
+ * comment, which takes the line ends after it along, so that the line
+ * goes on past them. Lexing the chunks one by one therefore gives the
+ * same lines as lexing the whole input. */
+const char * chunk_end(const char * begin, const char * end, size_t size)
+{
+    const char * p = (size_t) (end - begin) > size ? begin + size : end;
+    while (p < end) {
+        const char * line = p;
+        while (line > begin && !isLineEnd(line[-1]))
+            line--;
+        const char * eol = findCommentOrLineEnd(line, end);
+        bool comment = eol < end && !isLineEnd(*eol);
+        if (comment)
+            eol = findLineEnd(eol, end);
+        p = skipLineEnds(eol, end);
+        if (!comment)
             break;
+    }
+    return p;
+}
+
+/* Appends everything left in the stream in to text. */
+void read_all(FILE * in, vector<char> & text)
+{
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        text.insert(text.end(), buf, buf + n);
+    }
+}
+
+/* One range of input lines in -j mode, and what reporting on it printed. */
+struct Chunk {
+    const char * begin;
+    const char * end;
+    ostringstream out;
+    Totals totals;
+    bool stopped = false;  // true if the chunk ended at incorrect tokens
+    bool done = false;     // true once out is complete
+};
+
+/* The -j mode: maps the input file into memory (or reads all of a
+ * stream), cuts it into chunks of lines, and reports on the chunks on a
+ * pool of opt.jobs threads. The output of every
+ * chunk is written as soon as all chunks before it have been, so it comes
+ * out in input order and byte for byte as the sequential loop prints it,
+ * including the stop at the first line with incorrect tokens. At most
+ * WINDOW chunks per thread are in flight, which bounds the output held in
+ * memory. */
+void process_parallel(const char * path, Options & opt)
+{
+    static const size_t CHUNK_BYTES = 256 * 1024;
+    static const size_t WINDOW = 4;
+
+    MappedFile mapped;
+    vector<char> text;
+    const char * pos;
+    const char * end;
+    if (path != nullptr && mapped.open(path)) {
+        pos = mapped.begin();
+        end = mapped.end();
+    } else {
+        FILE * in = path == nullptr ? nullptr : fopen(path, "r");
+        read_all(in != nullptr ? in : stdin, text);
+        if (in != nullptr) {
+            fclose(in);
+        }
+        pos = text.data();
+        end = pos + text.size();
+    }
+
+    Options settings = opt; // what every chunk starts from; opt takes the totals
+    settings.totals = Totals();
+
+    vector<unique_ptr<Chunk> > chunks; // chunks[i] is freed once written
+    mutex doneLock;
+    condition_variable doneSignal;
+    atomic<size_t> stopAt{SIZE_MAX};   // chunks after the first one stopped need not run
+    WorkPool pool(opt.jobs);           // declared last: its destructor runs the queued chunks while the rest is alive
+    size_t window = WINDOW * pool.threads();
+
+    size_t next = 0; // first chunk not yet written
+    bool stopped = false;
+    while (!stopped && (next < chunks.size() || pos < end)) {
+        // keep the pool busy
+        while (pos < end && chunks.size() - next < window) {
+            const char * e = chunk_end(pos, end, CHUNK_BYTES);
+            size_t index = chunks.size();
+            chunks.emplace_back(new Chunk);
+            Chunk * c = chunks.back().get();
+            c->begin = pos;
+            c->end = e;
+            pos = e;
+            pool.submit([c, index, &settings, &stopAt, &doneLock, &doneSignal] {
+                if (index <= stopAt.load(memory_order_relaxed)) {
+                    Options local = settings; // every chunk binds its own copy of the -D variables
+                    Lexer lex(c->begin, c->end);
+                    c->stopped = !process(lex, local, c->out);
+                    c->totals = local.totals;
+                    if (c->stopped) {
+                        size_t cur = stopAt.load(memory_order_relaxed);
+                        while (index < cur && !stopAt.compare_exchange_weak(cur, index)) {
+                        }
+                    }
+                }
+                lock_guard<mutex> guard(doneLock);
+                c->done = true;
+                doneSignal.notify_all();
+            });
         }
 
-        if (!postfix.empty()) {
+        // write the next chunk once it is done
+        Chunk * c = chunks[next].get();
+        {
+            unique_lock<mutex> guard(doneLock);
+            doneSignal.wait(guard, [c] { return c->done; });
+        }
+        string s = c->out.str();
+        cout.write(s.data(), s.size());
+        opt.totals.add(c->totals);
+        stopped = c->stopped;
+        chunks[next++].reset();
+    }
+    cout.flush();
+}
+
+/* Prints the phase times and counters gathered by --stats: as a table,
+ * or as one JSON object. Phase times of all threads are added up, so with
+ * -j they can exceed the wall time; write time is part of whichever phase
+ * was writing as well. */
+void print_stats(const PhaseStats & st, double nsPerTick, double wallNs, const Options & opt, ostream & out)
+{
+    unsigned threads = opt.jobs > 0 ? opt.jobs : 1;
+    if (opt.statsJson) {
+        out << fixed << setprecision(3) << "{\"wall_ms\": " << wallNs / 1e6
+            << ", \"threads\": " << threads << ", \"phases\": {";
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            out << (p ? ", " : "") << "\"" << PHASE_NAMES[p] << "\": {\"entries\": " << st.entries[p]
+                << ", \"ms\": " << st.ticks[p] * nsPerTick / 1e6 << "}";
+        }
+        out << "}, \"counters\": {";
+        for (int c = 0; c < COUNTER_COUNT; c++) {
+            out << (c ? ", " : "") << "\"" << COUNTER_NAMES[c] << "\": " << st.counts[c];
+        }
+        out << "}}" << endl;
+        return;
+    }
+    out << left << setw(10) << "phase" << right << setw(12) << "entries"
+        << setw(12) << "ms" << setw(12) << "ns/entry" << endl;
+    out << fixed;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        double ns = st.ticks[p] * nsPerTick;
+        out << left << setw(10) << PHASE_NAMES[p] << right << setw(12) << st.entries[p]
+            << setprecision(3) << setw(12) << ns / 1e6
+            << setprecision(1) << setw(12) << (st.entries[p] ? ns / st.entries[p] : 0.0) << endl;
+    }
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        out << left << setw(14) << COUNTER_NAMES[c] << right << setw(20) << st.counts[c] << endl;
+    }
+    out << setprecision(3) << "wall time " << wallNs / 1e6 << " ms on " << threads << " thread(s)" << endl;
+}
 
-            BET<Token> bet;
+int main(int argc, char ** argv)
+{
+    Options opt;
 
-            bool correct = bet.buildFromPostfix(postfix);
+    // options come before the input file; drop them so that
+    // the file name ends up in argv[1]
+    while (argc > 1 && argv[1][0] == '-' && argv[1][1] != '\0') {
+        if (strcmp(argv[1], "-f") == 0) {
+            opt.flat = true;
+        } else if (strcmp(argv[1], "-e") == 0) {
+            opt.eval = true;
+        } else if (strcmp(argv[1], "-s") == 0) {
+            opt.simplify = true;
+        } else if (strcmp(argv[1], "-d") == 0) {
+            opt.dag = true;
+        } else if (strcmp(argv[1], "-p") == 0) {
+            opt.profile = true;
+        } else if (strcmp(argv[1], "-c") == 0) {
+            opt.cow = true;
+        } else if (strcmp(argv[1], "-a") == 0) {
+            opt.allocs = true;
+        } else if (strcmp(argv[1], "-i") == 0) {
+            opt.infix = true;
+        } else if (strcmp(argv[1], "-b") == 0) {
+            opt.image = true;
+        } else if (strcmp(argv[1], "-o") == 0 && argc > 2) {
+            opt.saveTo = argv[2];
+            argv[1] = argv[0];
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "--stats") == 0 || strcmp(argv[1], "--stats=text") == 0) {
+            opt.stats = true;
+        } else if (strcmp(argv[1], "--stats=json") == 0) {
+            opt.stats = true;
+            opt.statsJson = true;
+        } else if (strcmp(argv[1], "-j") == 0 && argc > 2 && atoi(argv[2]) > 0) {
+            opt.jobs = (unsigned) atoi(argv[2]);
+            argv[1] = argv[0];
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "-D") == 0 && argc > 2 && strchr(argv[2], '=') != nullptr) {
+            // -D name=value binds a variable for -e
+            char * eq = strchr(argv[2], '=');
+            string name(argv[2], eq - argv[2]);
+            int cls = strpbrk(eq + 1, ".eE") != nullptr ? SYM_FLOAT : SYM_INTEG;
+            opt.env.set(name, Value::parse(eq + 1, cls));
+            argv[1] = argv[0];
+            argv++;
+            argc--;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
 
-            if (!correct) {
-                cout << "Incorrect construction from postfix ...\n" << endl;
-            } else if (!bet.empty()) {
-                cout << "Postfix expression: ";
-                bet.printPostfixExpression();
+    if (opt.flat && (opt.eval || opt.simplify || opt.dag || opt.cow)) {
+        usage(argv[0]);
+        return 1;
+    }
 
-                cout << "Infix expression: ";
-                bet.printInfixExpression();
+    // images are read and written in order, by one thread; an image
+    // holds postfix expressions only, and has to be a file to be mapped
+    if ((opt.jobs > 0 && (opt.saveTo != nullptr || opt.image)) ||
+        (opt.image && (opt.infix || opt.saveTo != nullptr || argc < 2))) {
+        usage(argv[0]);
+        return 1;
+    }
 
-                cout << "Number of nodes: ";
-                cout << bet.size() << endl;
+    // --stats: everything written to cout goes through a buffer that counts and times it
+    PhaseStats written;
+    CountingBuffer counting(cout.rdbuf(), written);
+    streambuf * console = nullptr;
+    if (BET_STATS && opt.stats) {
+        console = cout.rdbuf(&counting);
+    }
+    auto wallStart = chrono::steady_clock::now();
+    uint64_t ticksStart = readTicks();
 
-                cout << "Number of leaf nodes: ";
-                cout << bet.leaves() << endl;
+    if (opt.image) {
+#if BET_STATS
+        size_t allocations = heapAllocations();
+#endif
+        bool ok = opt.flat ? process_image<FlatBET>(argv[1], opt, cout)
+                           : process_image<BET<Token> >(argv[1], opt, cout);
+        PHASE_ADD(opt.totals.phases, COUNT_ALLOCATIONS, heapAllocations() - allocations);
+        if (!ok) {
+            return 1;
+        }
+    } else if (opt.jobs > 0) {
+        process_parallel(argc < 2 ? nullptr : argv[1], opt);
+    } else {
+        Lexer lex;
+        if (argc < 2 || (!lex.map(argv[1]) && !lex.open(argv[1]))) {
+            lex.setInput(stdin);
+        }
+        process(lex, opt, cout);
+    }
 
-                cout << "Depth of tree: ";
-                cout << bet.depth() << endl;
+    if (opt.saveTo != nullptr && !opt.saved.save(opt.saveTo)) {
+        cerr << argv[0] << ": cannot write " << opt.saveTo << endl;
+        return 1;
+    }
 
-                cout << "Breadth of tree: ";
-                cout << bet.breadth() << endl;
+    if (opt.simplify) {
+        cout << "Simplification eliminated " << opt.totals.nodesEliminated << " of "
+             << opt.totals.nodesBuilt << " nodes" << endl;
+    }
 
-                // test copy constructor
-                BET<Token> bet2(bet);
-                cout << "Testing copy constructor: ";
-                bet2.printInfixExpression();
+    if (opt.allocs && !BET_STATS) {
+        cerr << argv[0] << ": built with BET_STATS=0, -a has nothing to report" << endl;
+    } else if (opt.allocs) {
+        cout << "Heap allocations while parsing: " << opt.totals.allocations << " in "
+             << opt.totals.allocatingLines << " of " << opt.totals.lines << " lines" << endl;
+    }
 
-                // test assignment operator
-                BET<Token> bet3;
-                bet3 = bet;
-                cout << "Testing assignment operator: ";
-                bet3.printInfixExpression();
-            }
-            cout << "Terminating one postfix expression ...\n" << endl;
-            postfix.clear();
+    if (opt.stats) {
+        if (!BET_STATS) {
+            cerr << argv[0] << ": built with BET_STATS=0, --stats has nothing to report" << endl;
+            return 0;
         }
-    } while (ret > SYM_NULL);
+        cout.flush();
+        cout.rdbuf(console);
+        uint64_t ticks = readTicks() - ticksStart;
+        double wallNs = chrono::duration<double, nano>(chrono::steady_clock::now() - wallStart).count();
+        opt.totals.phases.add(written);
+        print_stats(opt.totals.phases, ticks ? wallNs / ticks : 1.0, wallNs, opt, cerr);
+    }
 
     return 0;
 }
@@ -0,0 +1,207 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/* Writes random, valid postfix expressions to the standard output, one per
+ * line, as workloads for bet_driver, bet_bench and eval_bench.
+ *
+ *   -n operators  operators per expression (default 1000)
+ *   -l lines      number of expressions (default 100)
+ *   -s shape      balanced, left (a b + c + ...), right (a b c ... + +)
+ *                 or random (default)
+ *   -o operators  the operators to pick from, uniformly; repeat one to
+ *                 weight it, e.g. "++-*" (default: all four once)
+ *   -v ratio      fraction of the operands that are variables rather than
+ *                 numbers, 0 to 1 (default 0.5)
+ *   -p names      number of distinct variables (default 26)
+ *   -w chars      length every variable name is padded to with '_', to
+ *                 exercise long lexemes (default 1: no padding)
+ *   -r seed       seed of the random generator (default 1)
+ *
+ * Variables are a to z, then a1, b1 ... for larger pools. Half of the
+ * numbers are integers and half have a fraction. The same options and
+ * seed give the same output. */
+
+struct GenOptions {
+    long operators = 1000;
+    long lines = 100;
+    string shape = "random";
+    string ops = "+-*/";
+    double varRatio = 0.5;
+    long names = 26;
+    long width = 1;
+    unsigned long seed = 1;
+};
+
+class Generator {
+public:
+    Generator(const GenOptions & opt)
+            : opt{opt}, rng{opt.seed}
+    {
+        for (long k = 0; k < opt.names; k++) {
+            string name(1, (char) ('a' + k % 26));
+            if (k >= 26) {
+                name += to_string(k / 26);
+            }
+            if ((long) name.size() < opt.width) {
+                name.append(opt.width - name.size(), '_');
+            }
+            names.push_back(name);
+        }
+    }
+
+    /* Appends one expression, without its line end, to line. */
+    void expression(string & line)
+    {
+        long n = opt.operators;
+        if (opt.shape == "left") {
+            operand(line);
+            for (long i = 0; i < n; i++) {
+                operand(line);
+                op(line);
+            }
+        } else if (opt.shape == "right") {
+            for (long i = 0; i <= n; i++) {
+                operand(line);
+            }
+            for (long i = 0; i < n; i++) {
+                op(line);
+            }
+        } else if (opt.shape == "balanced") {
+            balanced(line, n + 1);
+        } else {
+            random(line, n);
+        }
+        if (!line.empty() && line.back() == ' ') {
+            line.pop_back();
+        }
+    }
+
+private:
+    /* A subtree with the given number of leaves, split as evenly as
+     * possible; recursion is only log2(leaves) deep. */
+    void balanced(string & line, long leaves)
+    {
+        if (leaves == 1) {
+            operand(line);
+            return;
+        }
+        balanced(line, leaves / 2);
+        balanced(line, leaves - leaves / 2);
+        op(line);
+    }
+
+    /* A random tree with n operators: every step pushes an operand or,
+     * if there are two subtrees to combine, an operator, in proportion
+     * to how many of each are left. */
+    void random(string & line, long n)
+    {
+        long operands = n + 1;
+        long operators = n;
+        long stack = 0;
+        while (operands > 0 || operators > 0) {
+            bool pushOperand;
+            if (operands == 0) {
+                pushOperand = false;
+            } else if (stack < 2) {
+                pushOperand = true;
+            } else {
+                pushOperand = uniform_int_distribution<long>(1, operands + operators)(rng) <= operands;
+            }
+            if (pushOperand) {
+                operand(line);
+                operands--;
+                stack++;
+            } else {
+                op(line);
+                operators--;
+                stack--;
+            }
+        }
+    }
+
+    void operand(string & line)
+    {
+        if (uniform_real_distribution<double>(0, 1)(rng) < opt.varRatio) {
+            line += names[uniform_int_distribution<long>(0, opt.names - 1)(rng)];
+        } else {
+            line += to_string(uniform_int_distribution<int>(0, 999)(rng));
+            if (uniform_int_distribution<int>(0, 1)(rng)) {
+                line += '.';
+                line += to_string(uniform_int_distribution<int>(0, 99)(rng));
+            }
+        }
+        line += ' ';
+    }
+
+    void op(string & line)
+    {
+        line += opt.ops[uniform_int_distribution<size_t>(0, opt.ops.size() - 1)(rng)];
+        line += ' ';
+    }
+
+    const GenOptions & opt;
+    mt19937_64 rng;
+    vector<string> names; // the variables, by index
+};
+
+void usage(const char * prog)
+{
+    cerr << "usage: " << prog << " [-n operators] [-l lines] [-s balanced|left|right|random]"
+         << " [-o operators] [-v variable-ratio] [-p names] [-w chars] [-r seed]" << endl;
+}
+
+int main(int argc, char ** argv)
+{
+    GenOptions opt;
+
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char * val = argv[i + 1];
+        if (strcmp(argv[i], "-n") == 0) {
+            opt.operators = atol(val);
+        } else if (strcmp(argv[i], "-l") == 0) {
+            opt.lines = atol(val);
+        } else if (strcmp(argv[i], "-s") == 0) {
+            opt.shape = val;
+        } else if (strcmp(argv[i], "-o") == 0) {
+            opt.ops = val;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            opt.varRatio = atof(val);
+        } else if (strcmp(argv[i], "-p") == 0) {
+            opt.names = atol(val);
+        } else if (strcmp(argv[i], "-w") == 0) {
+            opt.width = atol(val);
+        } else if (strcmp(argv[i], "-r") == 0) {
+            opt.seed = strtoul(val, nullptr, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opt.operators < 0 || opt.lines < 0 || opt.ops.empty() || opt.names < 1 || opt.width < 1
+        || opt.ops.find_first_not_of("+-*/") != string::npos
+        || (opt.shape != "balanced" && opt.shape != "left" && opt.shape != "right" && opt.shape != "random")) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Generator gen(opt);
+    string line;
+    for (long i = 0; i < opt.lines; i++) {
+        line.clear();
+        gen.expression(line);
+        line += '\n';
+        fwrite(line.data(), 1, line.size(), stdout);
+    }
+    return 0;
+}
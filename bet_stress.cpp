@@ -0,0 +1,175 @@
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "stress.h"
+
+using namespace std;
+
+/* Checks that expression trees survive what the other programs put them
+ * through. Each check can be run on its own by naming it; with no names,
+ * all of them run:
+ *   chains    builds, walks, copies, moves and destroys a left chain
+ *             "a a + a + ... a +" and a right chain "a a ... a + + ... +",
+ *             each with `levels` operators (ten million by default), far
+ *             deeper than the call stack could take if any traversal
+ *             recursed. The infix text of each must read back into the
+ *             same tree, and "0 *" over it must simplify away, first in a
+ *             copy-on-write copy, which must leave the original alone.
+ *   reparse   lexes and builds one line over and over through a
+ *             ParseContext, as bet_driver does: no line after the first
+ *             may allocate.
+ *   roundtrip random expressions must read back from the infix text
+ *             printInfixExpression gives them.
+ *   simplify  simplified random expressions must print postfix that
+ *             reads back.
+ *   eval      small random expressions over integer and double variables
+ *             must compute the same value in BET::evaluate and in every
+ *             compiled evaluator.
+ *   dag       random expressions added to one ExprDag must each evaluate,
+ *             from its root, to what BET::evaluate gives.
+ *   jit       where there is a JIT, random expressions and one too large
+ *             for the registers must compute in native code what the VM
+ *             computes.
+ *   image     random trees saved to an expression image must read back
+ *             from it unchanged.
+ * Exits 1 if any result is wrong. */
+
+static const long DEFAULT_LEVELS = 10000000;
+
+static int failures = 0;
+
+/* Ends the line, after "FAILED" and both values, counted, unless got == want. */
+static void verdict(long got, long want)
+{
+    if (got != want) {
+        cout << "  FAILED: got " << got << ", expected " << want;
+        failures++;
+    }
+    cout << endl;
+}
+
+/* Prints how long the phase since start took, and whether got == want. */
+void report(const char * phase, chrono::steady_clock::time_point start, long got, long want)
+{
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "  " << phase << ": " << ms << " ms";
+    verdict(got, want);
+}
+
+/* Prints how long the phase since start took. */
+void timing(const char * phase, chrono::steady_clock::time_point start)
+{
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "  " << phase << ": " << ms << " ms" << endl;
+}
+
+/* Prints whether got == want, with no time. */
+void check(const char * phase, long got, long want)
+{
+    cout << "  " << phase << ":" << (got == want ? " ok" : "");
+    verdict(got, want);
+}
+
+/* A random postfix expression of up to maxOperators operators over the
+ * variables v0 .. v(names - 1) and one-digit numbers, a quarter of them
+ * with ".5" if floats is set: every step pushes an operand, or combines
+ * the top two subtrees. */
+string randomPostfix(mt19937 & rng, int maxOperators, int names, bool floats)
+{
+    static const char OPS[] = "+-*/";
+    string postfix;
+    int operators = (int) (rng() % (maxOperators + 1));
+    int stack = 0;
+    while (operators > 0 || stack != 1) {
+        if (stack < 2 || (operators > 0 && rng() % 2 == 0)) {
+            if (rng() % 2) {
+                postfix += "v" + to_string(rng() % names);
+            } else {
+                postfix += to_string(rng() % 10);
+                if (floats && rng() % 4 == 0) {
+                    postfix += ".5";
+                }
+            }
+            stack++;
+        } else {
+            postfix += OPS[rng() % 4];
+            operators -= operators > 0;
+            stack--;
+        }
+        postfix += ' ';
+    }
+    return postfix;
+}
+
+
+/* Appends a complete tree of the given number of levels to postfix. */
+void balancedPostfix(mt19937 & rng, int levels, int names, string & postfix)
+{
+    static const char OPS[] = "+-*/";
+    if (levels == 0) {
+        postfix += "v" + to_string(rng() % names) + " ";
+        return;
+    }
+    balancedPostfix(rng, levels - 1, names, postfix);
+    balancedPostfix(rng, levels - 1, names, postfix);
+    postfix += OPS[rng() % 4];
+    postfix += ' ';
+}
+
+int main(int argc, char ** argv)
+{
+    long levels = DEFAULT_LEVELS;
+    const struct {
+        const char * name;
+        function<void()> run;
+    } checks[] = {
+        {"chains", [&levels]() { chainCheck(levels); }},
+        {"reparse", reparseCheck},
+        {"roundtrip", roundTripCheck},
+        {"simplify", simplifyCheck},
+        {"eval", evalCheck},
+        {"dag", dagCheck},
+        {"jit", jitCheck},
+        {"image", imageCheck},
+    };
+    const size_t CHECKS = sizeof(checks) / sizeof(checks[0]);
+
+    argc--;
+    argv++;
+    if (argc >= 2 && strcmp(argv[0], "-n") == 0) {
+        levels = atol(argv[1]);
+        argc -= 2;
+        argv += 2;
+    }
+    vector<bool> chosen(CHECKS, argc == 0);
+    for (int a = 0; a < argc; a++) {
+        size_t c = 0;
+        while (c < CHECKS && strcmp(argv[a], checks[c].name) != 0) {
+            c++;
+        }
+        if (c == CHECKS) {
+            cerr << "usage: bet_stress [-n levels] [check ...], where a check is one of";
+            for (auto & ch : checks) {
+                cerr << " " << ch.name;
+            }
+            cerr << endl;
+            return 1;
+        }
+        chosen[c] = true;
+    }
+
+    for (size_t c = 0; c < CHECKS; c++) {
+        if (chosen[c]) {
+            checks[c].run();
+        }
+    }
+
+    if (failures > 0) {
+        cout << failures << " check(s) failed" << endl;
+        return 1;
+    }
+    return 0;
+}
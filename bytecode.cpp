@@ -0,0 +1,109 @@
+#include "bytecode.h"
+
+/*
+ * evaluate prog with variable slot i bound to vars[i].
+ *
+ * With GCC and Clang every instruction jumps straight to the handler of
+ * the next one through a table of label addresses (computed goto), which
+ * gives the branch predictor one indirect jump per handler to learn.
+ * Other compilers get the same loop as a plain switch.
+ */
+double VM::run(const Program & prog, const double * vars)
+{
+    if (prog.empty())
+        return 0.0;
+    if (stack.size() < prog.maxStack())
+        stack.resize(prog.maxStack());
+
+    const Instr * ip = prog.code().data();
+    const double * consts = prog.consts().data();
+    double * sp = stack.data(); // first free stack cell
+
+#if defined(__GNUC__)
+    static void * const dispatch[] = {
+            &&op_ret,   // OP_RET
+            &&op_var,   // OP_VAR
+            &&op_const, // OP_CONST
+            &&op_add,   // OP_ADD
+            &&op_sub,   // OP_SUB
+            &&op_mul,   // OP_MUL
+            &&op_div,   // OP_DIV
+            &&op_idiv,  // OP_IDIV
+            &&op_imul,  // OP_IMUL
+    };
+    static_assert(sizeof(dispatch) / sizeof(dispatch[0]) == OP_IMUL + 1, "a handler for every Opcode");
+#define NEXT() goto *dispatch[(++ip)->op]
+
+    goto *dispatch[ip->op];
+op_var:
+    *sp++ = vars[ip->arg];
+    NEXT();
+op_const:
+    *sp++ = consts[ip->arg];
+    NEXT();
+op_add:
+    sp--;
+    sp[-1] += sp[0];
+    NEXT();
+op_sub:
+    sp--;
+    sp[-1] -= sp[0];
+    NEXT();
+op_mul:
+    sp--;
+    sp[-1] *= sp[0];
+    NEXT();
+op_div:
+    sp--;
+    sp[-1] /= sp[0];
+    NEXT();
+op_idiv:
+    sp--;
+    sp[-1] = truncQuotient(sp[-1] / sp[0]);
+    NEXT();
+op_imul:
+    sp--;
+    sp[-1] = intProduct(sp[-1] * sp[0]);
+    NEXT();
+op_ret:
+    return sp[-1];
+#undef NEXT
+#else
+    for (;; ip++) {
+        switch (ip->op) {
+            case OP_VAR:
+                *sp++ = vars[ip->arg];
+                break;
+            case OP_CONST:
+                *sp++ = consts[ip->arg];
+                break;
+            case OP_ADD:
+                sp--;
+                sp[-1] += sp[0];
+                break;
+            case OP_SUB:
+                sp--;
+                sp[-1] -= sp[0];
+                break;
+            case OP_MUL:
+                sp--;
+                sp[-1] *= sp[0];
+                break;
+            case OP_DIV:
+                sp--;
+                sp[-1] /= sp[0];
+                break;
+            case OP_IDIV:
+                sp--;
+                sp[-1] = truncQuotient(sp[-1] / sp[0]);
+                break;
+            case OP_IMUL:
+                sp--;
+                sp[-1] = intProduct(sp[-1] * sp[0]);
+                break;
+            default:
+                return sp[-1];
+        }
+    }
+#endif
+}
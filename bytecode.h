@@ -0,0 +1,171 @@
+#ifndef PROJ04SRC_BYTECODE_H
+#define PROJ04SRC_BYTECODE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "opnum.h"
+
+/*
+ * Instruction set of the expression VM, numbered independently of the
+ * lexer's SYM_* codes (arithOp maps those). The arithmetic instructions,
+ * OP_ADD .. OP_IMUL, are contiguous and in this order: each pops two
+ * values and pushes the result, and the evaluators index tables by
+ * op - OP_ADD.
+ */
+enum Opcode : uint8_t {
+    OP_RET,   // stop; the result is on top of the stack
+    OP_VAR,   // push vars[arg]
+    OP_CONST, // push consts[arg]
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_IDIV,  // divide and truncate toward zero, as Value::apply divides integers
+    OP_IMUL,  // multiply, giving +0 rather than -0 as integers do
+};
+
+const int ARITH_OPS = OP_IMUL - OP_ADD + 1; // number of arithmetic instructions
+
+inline bool isArith(Opcode op) { return op >= OP_ADD && op <= OP_IMUL; }
+
+struct Instr {
+    Opcode op;
+    uint32_t arg; // slot or constant index for the push instructions
+};
+
+/*
+ * q truncated toward zero, the way OP_IDIV finishes a division: through
+ * a 64-bit integer, so 0 comes out as +0 like the integer 0 does.
+ * A quotient that does not fit (a division by zero, a NaN operand, or
+ * |q| >= 2^63) is NaN, as an integer division by zero is in
+ * Value::apply. Every evaluator of Programs truncates with exactly this
+ * rule.
+ */
+inline double truncQuotient(double q)
+{
+    return q > -9223372036854775808.0 && q < 9223372036854775808.0 ? (double) (int64_t) q
+                                                                   : std::numeric_limits<double>::quiet_NaN();
+}
+
+/*
+ * a product of integers as OP_IMUL gives it: adding +0 turns -0 (from 0
+ * times a negative number) into +0 and leaves every other value alone.
+ */
+inline double intProduct(double p)
+{
+    return p + 0.0;
+}
+
+/*
+ * the instruction for the lexer's operator op (SYM_ADD .. SYM_DIV) on two
+ * operands; integers is true if both are integers.
+ */
+inline Opcode arithOp(int op, bool integers)
+{
+    switch (op) {
+        case SYM_ADD: return OP_ADD;
+        case SYM_SUB: return OP_SUB;
+        case SYM_MUL: return integers ? OP_IMUL : OP_MUL;
+        default:      return integers ? OP_IDIV : OP_DIV;
+    }
+}
+
+/*
+ * A compiled expression: a linear postfix instruction stream, the pool
+ * of constants it pushes, and the deepest stack it needs.
+ * Built by BET::compile.
+ *
+ * Values are doubles, but integers keep the meaning they have in
+ * BET::evaluate: the compiler knows which operands are integers (integer
+ * literals, and variables bound to integers when it ran), divides those
+ * with OP_IDIV and multiplies them with OP_IMUL. Results agree with
+ * evaluate() as long as the integers involved stay within the 53 bits a
+ * double holds exactly; an integer division by zero is NaN in both.
+ *
+ * A Program is therefore compiled for the types its variables had, which
+ * it records (integerVar): it is only valid for bindings of the same
+ * types. After a variable changes between integer and double, check
+ * Environment::fits and compile again.
+ */
+class Program {
+public:
+    Program() : depth{0}, maxDepth{0}, maxSlot{-1} { }
+
+    void clear()
+    {
+        instrs.clear();
+        pool.clear();
+        varTypes.clear();
+        depth = maxDepth = 0;
+        maxSlot = -1;
+    }
+
+    void emitConst(double v)
+    {
+        instrs.push_back(Instr{OP_CONST, (uint32_t) pool.size()});
+        pool.push_back(v);
+        push();
+    }
+
+    // integer: the variable is bound to an integer, as the code assumes
+    void emitVar(int slot, bool integer)
+    {
+        instrs.push_back(Instr{OP_VAR, (uint32_t) slot});
+        if (slot > maxSlot)
+            maxSlot = slot;
+        if (varTypes.size() <= (size_t) slot)
+            varTypes.resize(slot + 1, -1);
+        varTypes[slot] = integer;
+        push();
+    }
+
+    void emitOp(Opcode op)
+    {
+        instrs.push_back(Instr{op, 0});
+        depth--;
+    }
+
+    void emitRet()
+    {
+        instrs.push_back(Instr{OP_RET, 0});
+    }
+
+    const std::vector<Instr> & code() const { return instrs; }
+    const std::vector<double> & consts() const { return pool; }
+    size_t maxStack() const { return maxDepth; }
+    size_t slots() const { return (size_t) (maxSlot + 1); } // vars[] must hold at least this many values
+    bool reads(size_t slot) const { return slot < varTypes.size() && varTypes[slot] >= 0; } // true if the code pushes vars[slot]
+    bool integerVar(size_t slot) const { return slot < varTypes.size() && varTypes[slot] > 0; } // true if the code treats vars[slot] as an integer
+    bool empty() const { return instrs.empty(); }
+
+private:
+    void push()
+    {
+        if (++depth > maxDepth)
+            maxDepth = depth;
+    }
+
+    std::vector<Instr> instrs;
+    std::vector<double> pool;
+    std::vector<int8_t> varTypes; // slot -> 1 if compiled for an integer, 0 for a double, -1 if not read
+    size_t depth;    // stack depth after the last emitted instruction
+    size_t maxDepth; // deepest the stack gets
+    int maxSlot;     // highest variable slot referenced
+};
+
+/*
+ * Runs Programs. The value stack is kept between runs and only grows when
+ * a deeper program comes along, so evaluating does not allocate.
+ */
+class VM {
+public:
+    double run(const Program & prog, const double * vars); //evaluate prog with variable slot i bound to vars[i]
+
+private:
+    std::vector<double> stack;
+};
+
+#endif //PROJ04SRC_BYTECODE_H
@@ -0,0 +1,125 @@
+#ifndef PROJ04SRC_CHAR_SCAN_H
+#define PROJ04SRC_CHAR_SCAN_H
+
+#include <cstddef>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * Searches over a range of text for the characters the lexical grammar
+ * cares about in bulk: blanks, line ends and "//". With SSE2 (every
+ * x86-64 compiler) they look at 16 bytes per step; elsewhere they fall
+ * back to a plain loop. Each returns end if the search runs off the range.
+ */
+
+inline bool isBlank(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+inline bool isLineEnd(char c)
+{
+    return c == '\n' || c == '\r';
+}
+
+#if defined(__SSE2__)
+
+/*
+ * first position of [p, end) at which the 16-byte mask found by test is
+ * set, or the position where fewer than 16 bytes are left.
+ */
+template <typename Test>
+inline const char * scanBlocks(const char * p, const char * end, Test test)
+{
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) p);
+        unsigned mask = (unsigned) _mm_movemask_epi8(test(v));
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return p;
+}
+
+inline __m128i lineEndMask(__m128i v)
+{
+    return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+}
+
+inline __m128i blankMask(__m128i v)
+{
+    return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+}
+
+#endif
+
+/*
+ * the first line end in [p, end).
+ */
+inline const char * findLineEnd(const char * p, const char * end)
+{
+#if defined(__SSE2__)
+    p = scanBlocks(p, end, [](__m128i v) { return lineEndMask(v); });
+#endif
+    while (p < end && !isLineEnd(*p))
+        p++;
+    return p;
+}
+
+/*
+ * the first character of [p, end) that is not a blank.
+ */
+inline const char * skipBlanks(const char * p, const char * end)
+{
+    // a single blank between tokens is by far the common case
+    if (p < end && !isBlank(*p))
+        return p;
+#if defined(__SSE2__)
+    p = scanBlocks(p, end, [](__m128i v) { return _mm_xor_si128(blankMask(v), _mm_set1_epi8(-1)); });
+#endif
+    while (p < end && isBlank(*p))
+        p++;
+    return p;
+}
+
+/*
+ * the first character of [p, end) that is not a line end.
+ */
+inline const char * skipLineEnds(const char * p, const char * end)
+{
+    if (p < end && !isLineEnd(*p))
+        return p;
+#if defined(__SSE2__)
+    p = scanBlocks(p, end, [](__m128i v) { return _mm_xor_si128(lineEndMask(v), _mm_set1_epi8(-1)); });
+#endif
+    while (p < end && isLineEnd(*p))
+        p++;
+    return p;
+}
+
+/*
+ * the first line end or "//" in [p, end), whichever comes first.
+ */
+inline const char * findCommentOrLineEnd(const char * p, const char * end)
+{
+#if defined(__SSE2__)
+    while (end - p >= 17) {
+        __m128i v = _mm_loadu_si128((const __m128i *) p);
+        __m128i next = _mm_loadu_si128((const __m128i *) (p + 1));
+        __m128i slash = _mm_set1_epi8('/');
+        __m128i hit = _mm_or_si128(lineEndMask(v),
+                                   _mm_and_si128(_mm_cmpeq_epi8(v, slash), _mm_cmpeq_epi8(next, slash)));
+        unsigned mask = (unsigned) _mm_movemask_epi8(hit);
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && !isLineEnd(*p) && !(p[0] == '/' && p + 1 < end && p[1] == '/'))
+        p++;
+    return p;
+}
+
+#endif //PROJ04SRC_CHAR_SCAN_H
@@ -0,0 +1,130 @@
+#include "closure.h"
+
+/*
+ * the arithmetic instruction OP (OP_ADD .. OP_IMUL) on doubles, as
+ * VM::run does it.
+ */
+template <int OP>
+static inline double apply(double x, double y)
+{
+    switch (OP) {
+        case OP_ADD: return x + y;
+        case OP_SUB: return x - y;
+        case OP_MUL: return x * y;
+        case OP_DIV: return x / y;
+        case OP_IDIV: return truncQuotient(x / y);
+        default:      return intProduct(x * y);
+    }
+}
+
+static double applyOp(Opcode op, double x, double y)
+{
+    switch (op) {
+        case OP_ADD: return apply<OP_ADD>(x, y);
+        case OP_SUB: return apply<OP_SUB>(x, y);
+        case OP_MUL: return apply<OP_MUL>(x, y);
+        case OP_DIV: return apply<OP_DIV>(x, y);
+        case OP_IDIV: return apply<OP_IDIV>(x, y);
+        default:      return apply<OP_IMUL>(x, y);
+    }
+}
+
+// one function per shape and operator; K is a constant, X a variable and
+// N a subtree, left operand first
+
+typedef ClosureTree::Node Node;
+
+static double evalK(const Node * n, const double *) { return n->k; }
+static double evalX(const Node * n, const double * v) { return v[n->a]; }
+
+template <int OP> static double evalXK(const Node * n, const double * v) { return apply<OP>(v[n->a], n->k); }
+template <int OP> static double evalKX(const Node * n, const double * v) { return apply<OP>(n->k, v[n->a]); }
+template <int OP> static double evalXX(const Node * n, const double * v) { return apply<OP>(v[n->a], v[n->b]); }
+template <int OP> static double evalNK(const Node * n, const double * v) { return apply<OP>(n->left->fn(n->left, v), n->k); }
+template <int OP> static double evalKN(const Node * n, const double * v) { return apply<OP>(n->k, n->right->fn(n->right, v)); }
+template <int OP> static double evalNX(const Node * n, const double * v) { return apply<OP>(n->left->fn(n->left, v), v[n->a]); }
+template <int OP> static double evalXN(const Node * n, const double * v) { return apply<OP>(v[n->a], n->right->fn(n->right, v)); }
+template <int OP> static double evalNN(const Node * n, const double * v)
+{
+    return apply<OP>(n->left->fn(n->left, v), n->right->fn(n->right, v));
+}
+
+enum Kind { K, X, N };
+
+#define BY_OP(f) { f<OP_ADD>, f<OP_SUB>, f<OP_MUL>, f<OP_DIV>, f<OP_IDIV>, f<OP_IMUL> }
+
+// [left kind][right kind][op - OP_ADD]; two constants are folded instead
+static const ClosureTree::Fn SHAPES[3][3][ARITH_OPS] = {
+        /* K */ { { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr }, BY_OP(evalKX), BY_OP(evalKN) },
+        /* X */ { BY_OP(evalXK), BY_OP(evalXX), BY_OP(evalXN) },
+        /* N */ { BY_OP(evalNK), BY_OP(evalNX), BY_OP(evalNN) },
+};
+
+#undef BY_OP
+
+/*
+ * build the tree of prog: its postfix code is run once on a stack of
+ * operand descriptions, and every operator becomes a node made for the
+ * kinds of its two operands.
+ */
+bool ClosureTree::compile(const Program & prog)
+{
+    struct Operand {
+        Kind kind;
+        uint32_t slot;       // X: the variable
+        double k;            // K: the value
+        const Node * node;   // N: the subtree
+        size_t depth;        // operators nested in it
+    };
+
+    nodes.clear();
+    root = nullptr;
+    if (prog.empty())
+        return false;
+    nodes.reserve(prog.code().size());
+
+    std::vector<Operand> stack;
+    stack.reserve(prog.maxStack());
+    for (const Instr & ins : prog.code()) {
+        if (ins.op == OP_VAR) {
+            stack.push_back(Operand{X, ins.arg, 0.0, nullptr, 0});
+        } else if (ins.op == OP_CONST) {
+            stack.push_back(Operand{K, 0, prog.consts()[ins.arg], nullptr, 0});
+        } else if (isArith(ins.op)) {
+            Operand r = stack.back();
+            stack.pop_back();
+            Operand & l = stack.back();
+            if (l.kind == K && r.kind == K) {
+                l.k = applyOp(ins.op, l.k, r.k);
+                continue;
+            }
+            Node n = Node{SHAPES[l.kind][r.kind][ins.op - OP_ADD], l.node, r.node, 0, 0, 0.0};
+            if (l.kind == X) {
+                n.a = l.slot;
+                n.b = r.slot;
+            } else {
+                n.a = r.slot;
+            }
+            n.k = l.kind == K ? l.k : r.k;
+            nodes.push_back(n);
+            size_t depth = 1 + (l.depth > r.depth ? l.depth : r.depth);
+            if (depth > MAX_DEPTH) {
+                nodes.clear();
+                return false;
+            }
+            l = Operand{N, 0, 0.0, &nodes.back(), depth};
+        } else {
+            break; // OP_RET
+        }
+    }
+
+    // an expression that is a single operand gets a leaf of its own
+    const Operand & top = stack.back();
+    if (top.kind == N) {
+        root = top.node;
+    } else {
+        nodes.push_back(Node{top.kind == K ? evalK : evalX, nullptr, nullptr, top.slot, 0, top.k});
+        root = &nodes.back();
+    }
+    return true;
+}
@@ -0,0 +1,66 @@
+#ifndef PROJ04SRC_CLOSURE_H
+#define PROJ04SRC_CLOSURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "bytecode.h"
+
+/*
+ * An expression compiled into a tree of pre-bound calls. Every node holds
+ * a pointer to a function made for its exact shape and operator, such as
+ * "variable + constant" or "subtree * variable", with its variable slots
+ * and its constants, already as doubles, stored in the node. Evaluating
+ * is one indirect call per operator: there is no token to look at, no
+ * opcode to dispatch on and no stack to push to. Leaves are folded into
+ * their parents, and operators on two constants are computed once when
+ * the tree is compiled.
+ *
+ * It is compiled from the bytecode of BET::compile and computes exactly
+ * what VM::run computes. Evaluation recurses once per level, so a program
+ * deeper than MAX_DEPTH is refused; run it on the VM instead.
+ */
+class ClosureTree {
+public:
+    static const size_t MAX_DEPTH = 10000; // deepest nesting of operators compile() accepts
+
+    ClosureTree() : root{nullptr} { }
+
+    ClosureTree(const ClosureTree &) = delete;              // nodes point at each other
+    ClosureTree & operator= (const ClosureTree &) = delete;
+
+    // moving keeps the nodes where they are
+    ClosureTree(ClosureTree && t) noexcept : nodes{std::move(t.nodes)}, root{t.root} { t.root = nullptr; }
+    ClosureTree & operator= (ClosureTree && t) noexcept
+    {
+        nodes.swap(t.nodes);
+        std::swap(root, t.root);
+        return *this;
+    }
+
+    bool compile(const Program & prog); //build the tree of prog. Return false, leaving the tree empty, if prog is empty or deeper than MAX_DEPTH.
+    double run(const double * vars) const { return root != nullptr ? root->fn(root, vars) : 0.0; } //evaluate with variable slot i bound to vars[i]; 0 if empty
+
+    bool empty() const { return root == nullptr; }
+    size_t size() const { return nodes.size(); } //number of calls one evaluation makes
+
+    struct Node;
+    typedef double (*Fn)(const Node * n, const double * vars);
+
+    struct Node {
+        Fn fn;              // evaluates the node
+        const Node * left;  // operand subtrees, for the shapes that have them
+        const Node * right;
+        uint32_t a;         // variable slot of the left operand, or of the only variable operand
+        uint32_t b;         // variable slot of the right operand when both are variables
+        double k;           // the constant operand
+    };
+
+private:
+    std::vector<Node> nodes; // reserved up front: nodes point at each other
+    const Node * root;
+};
+
+#endif //PROJ04SRC_CLOSURE_H
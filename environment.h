@@ -0,0 +1,256 @@
+#ifndef PROJ04SRC_ENVIRONMENT_H
+#define PROJ04SRC_ENVIRONMENT_H
+
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "opnum.h"
+#include "token.h"
+#include "bytecode.h"
+
+/*
+ * Result of evaluating an expression: a 64-bit integer as long as every
+ * operand involved is an integer, a double as soon as one of them is not.
+ */
+struct Value {
+    bool isInt;
+    union {
+        int64_t i;
+        double d;
+    };
+
+    Value() : isInt{true}, i{0} { }
+
+    static Value ofInt(int64_t v)
+    {
+        Value r;
+        r.isInt = true;
+        r.i = v;
+        return r;
+    }
+
+    static Value ofDouble(double v)
+    {
+        Value r;
+        r.isInt = false;
+        r.d = v;
+        return r;
+    }
+
+    double asDouble() const { return isInt ? (double) i : d; }
+
+    /*
+     * parse the lexeme of a SYM_INTEG or SYM_FLOAT token. Integers that
+     * do not fit in 64 bits become doubles. Anything else yields 0.
+     */
+    static Value parse(const char *lexeme, int cls)
+    {
+        if (cls == SYM_INTEG) {
+            errno = 0;
+            long long v = strtoll(lexeme, nullptr, 10);
+            if (errno != ERANGE)
+                return ofInt(v);
+            return ofDouble(strtod(lexeme, nullptr));
+        }
+        if (cls == SYM_FLOAT)
+            return ofDouble(strtod(lexeme, nullptr));
+        return Value();
+    }
+
+    /*
+     * value of a SYM_INTEG or SYM_FLOAT token, as parsed when the token
+     * was made. Integers that do not fit in 64 bits are doubles.
+     * Anything else yields 0.
+     */
+    static Value of(const Token & tok)
+    {
+        if (tok.isInteger())
+            return ofInt(tok.getInteger());
+        if (tok.getType() == SYM_INTEG || tok.getType() == SYM_FLOAT)
+            return ofDouble(tok.getNumber());
+        return Value();
+    }
+
+    /*
+     * true if lexeme() reads back as this value: the lexer has no sign and
+     * no exponent, so negative numbers (and -0.0), infinities, NaN and
+     * doubles that print with an exponent have no literal.
+     */
+    bool hasLexeme() const
+    {
+        if (isInt)
+            return i >= 0;
+        return std::isfinite(d) && !std::signbit(d) && strpbrk(lexeme().c_str(), "eE") == nullptr;
+    }
+
+    /*
+     * text for a literal holding this value: integers as is, doubles with
+     * the fewest digits that read back to the same double and always with
+     * a decimal point or exponent, so the kind survives a round trip.
+     */
+    std::string lexeme() const
+    {
+        if (isInt)
+            return std::to_string(i);
+        char buf[40];
+        for (int prec = 15; prec <= 17; prec++) {
+            snprintf(buf, sizeof(buf), "%.*g", prec, d);
+            if (strtod(buf, nullptr) == d)
+                break;
+        }
+        if (strpbrk(buf, ".eEn") == nullptr) // 'n' keeps inf and nan as they are
+            strcat(buf, ".0");
+        return buf;
+    }
+
+    /*
+     * apply the operator op (SYM_ADD .. SYM_DIV) to a and b.
+     * Integer arithmetic wraps around like unsigned arithmetic instead of
+     * overflowing, so INT64_MIN / -1 is INT64_MIN; integer division
+     * truncates toward zero, and an integer division by zero is NaN, which
+     * every later operation keeps.
+     */
+    static Value apply(int op, Value a, Value b)
+    {
+        if (a.isInt && b.isInt) {
+            uint64_t x = (uint64_t) a.i, y = (uint64_t) b.i;
+            switch (op) {
+                case SYM_ADD: return ofInt((int64_t) (x + y));
+                case SYM_SUB: return ofInt((int64_t) (x - y));
+                case SYM_MUL: return ofInt((int64_t) (x * y));
+                case SYM_DIV:
+                    if (b.i == 0)
+                        return ofDouble(std::numeric_limits<double>::quiet_NaN());
+                    return ofInt(b.i == -1 ? (int64_t) (0 - x) : a.i / b.i);
+                default: return Value();
+            }
+        }
+        double x = a.asDouble(), y = b.asDouble();
+        switch (op) {
+            case SYM_ADD: return ofDouble(x + y);
+            case SYM_SUB: return ofDouble(x - y);
+            case SYM_MUL: return ofDouble(x * y);
+            case SYM_DIV: return ofDouble(x / y);
+            default: return Value();
+        }
+    }
+};
+
+inline std::ostream & operator<<(std::ostream &os, const Value & v)
+{
+    if (v.isInt)
+        os << v.i;
+    else
+        os << v.d;
+    return os;
+}
+
+/*
+ * Variable bindings for BET::evaluate.
+ *
+ * Every variable name gets a small integer slot the first time it is seen
+ * and keeps it for the lifetime of the environment. A tree resolves its
+ * names to slots once, so repeated evaluations only index into a vector.
+ * A variable that has never been set evaluates to the integer 0.
+ */
+class Environment {
+public:
+    Environment() : envId{nextId()} { }
+
+    // copies get their own id: slots match, but trees bound to the
+    // original must not skip resolution against the copy
+    Environment(const Environment & e)
+            : envId{nextId()}, slots{e.slots}, names{e.names}, values{e.values} { }
+
+    Environment & operator= (const Environment & e)
+    {
+        if (this != &e) {
+            envId = nextId();
+            slots = e.slots;
+            names = e.names;
+            values = e.values;
+        }
+        return *this;
+    }
+
+    /*
+     * return the slot of name, creating it (bound to 0) if it is new.
+     */
+    int slot(const std::string & name)
+    {
+        auto it = slots.find(name);
+        if (it != slots.end())
+            return it->second;
+        int s = (int) names.size();
+        slots.emplace(name, s);
+        names.push_back(name);
+        values.push_back(Value());
+        return s;
+    }
+
+    /*
+     * return the slot of name, or -1 if it has none.
+     */
+    int find(const std::string & name) const
+    {
+        auto it = slots.find(name);
+        return it == slots.end() ? -1 : it->second;
+    }
+
+    void set(int s, Value v) { values[s] = v; }
+    void set(const std::string & name, Value v) { values[slot(name)] = v; }
+    const Value & get(int s) const { return values[s]; }
+    const std::string & name(int s) const { return names[s]; }
+    size_t size() const { return names.size(); }
+
+    /*
+     * write the value of every slot into out as a double: the variable
+     * layout the compiled evaluators (VM::run) expect.
+     */
+    void toDoubles(std::vector<double> & out) const
+    {
+        out.resize(values.size());
+        for (size_t s = 0; s < values.size(); s++)
+            out[s] = values[s].asDouble();
+    }
+
+    /*
+     * true if every variable prog reads is bound to a value of the type
+     * prog was compiled for, so that it computes what BET::evaluate does.
+     */
+    bool fits(const Program & prog) const
+    {
+        for (size_t s = 0; s < prog.slots(); s++) {
+            if (prog.reads(s) && (s >= values.size() || values[s].isInt != prog.integerVar(s)))
+                return false;
+        }
+        return true;
+    }
+
+    // identifies this environment; trees remember which one they resolved their names in
+    uint64_t id() const { return envId; }
+
+private:
+    static uint64_t nextId()
+    {
+        static std::atomic<uint64_t> counter{0};
+        return ++counter;
+    }
+
+    uint64_t envId;
+    std::unordered_map<std::string, int> slots;
+    std::vector<std::string> names;
+    std::vector<Value> values;
+};
+
+#endif //PROJ04SRC_ENVIRONMENT_H
@@ -0,0 +1,217 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <list>
+
+#include "opnum.h"
+#include "lexer.h"
+#include "token.h"
+#include "bet.h"
+#include "bytecode.h"
+#include "closure.h"
+#include "jit.h"
+#include "batch_eval.h"
+#include "environment.h"
+
+using namespace std;
+
+/* Compares evaluation strategies on every expression of the input:
+ * walking the BET (BET::evaluate) against running its bytecode (VM::run),
+ * calling its closure tree (ClosureTree::run) and, on x86-64, calling
+ * its native code (JitProgram).
+ * Every variable is bound to a distinct double. Each strategy evaluates
+ * the expression n times per run; the best of several runs is reported
+ * in nanoseconds per evaluation. -x k scales every expression up to k
+ * copies of itself added together.
+ * It then evaluates the expression over a table of ROWS rows, once row by
+ * row with the VM and once batch by batch with BatchEvaluator, and reports
+ * nanoseconds per row. */
+
+static const int RUNS = 5;
+static const size_t ROWS = 16384;
+
+/* Reads one line of tokens, storing long lexemes in names. Returns false
+ * if the line has invalid tokens. */
+static bool read_line(Lexer & lex, std::list<Token> & postfix, Lexicon & names, int * ret)
+{
+    bool ok = true;
+    int retval = 0;
+    do {
+        retval = lex.next();
+        if (retval >= SYM_INVAL) {
+            ok = false;
+        } else if (retval > SYM_NULL && retval < SYM_ENDLN) {
+            postfix.push_back(Token(lex.lexeme(), retval, names));
+        }
+    } while (retval > SYM_NULL && retval != SYM_ENDLN);
+    *ret = retval;
+    return ok;
+}
+
+/* Replaces postfix by k copies of itself added together. */
+static void scale(std::list<Token> & postfix, long k)
+{
+    std::list<Token> one(postfix);
+    Token plus("+"sv, SYM_ADD);
+    for (long i = 1; i < k; i++) {
+        postfix.insert(postfix.end(), one.begin(), one.end());
+        postfix.push_back(plus);
+    }
+}
+
+/* Best time over RUNS runs of n calls to f, in nanoseconds per call. */
+template <typename F>
+static double time_per_call(long n, F f)
+{
+    double best = 0;
+    for (int r = 0; r < RUNS; r++) {
+        auto start = chrono::steady_clock::now();
+        for (long i = 0; i < n; i++) {
+            f();
+        }
+        double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / n;
+        if (r == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char ** argv)
+{
+    long n = 1000000;
+    long k = 1;
+
+    // options come before the input file, as in bet_driver
+    while (argc > 1 && argv[1][0] == '-' && argv[1][1] != '\0') {
+        if (strcmp(argv[1], "-n") == 0 && argc > 2) {
+            n = atol(argv[2]);
+            argv[2] = argv[0];
+            argv++;
+            argc--;
+        } else if (strcmp(argv[1], "-x") == 0 && argc > 2 && atol(argv[2]) > 0) {
+            k = atol(argv[2]);
+            argv[2] = argv[0];
+            argv++;
+            argc--;
+        } else {
+            cerr << "usage: " << argv[0] << " [-n evaluations] [-x scale] [file]" << endl;
+            return 1;
+        }
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+    if (n <= 0) {
+        n = 1;
+    }
+
+    Lexer lex;
+    if (argc < 2 || (!lex.map(argv[1]) && !lex.open(argv[1]))) {
+        lex.setInput(stdin);
+    }
+
+    int ret = 0;
+    int mismatches = 0;
+    std::list<Token> postfix;
+    Lexicon names; // the long lexemes of postfix
+    do {
+        postfix.clear();
+        names.clear();
+        if (!read_line(lex, postfix, names, &ret) || postfix.empty()) {
+            continue;
+        }
+        scale(postfix, k);
+        BET<Token> bet;
+        if (!bet.buildFromPostfix(postfix)) {
+            continue;
+        }
+
+        Environment env;
+        Program prog;
+        VM vm;
+        bet.compile(prog, env); // gives every variable its slot
+        for (size_t s = 0; s < env.size(); s++) {
+            env.set((int) s, Value::ofDouble(1.5 + 0.25 * s));
+        }
+        bet.compile(prog, env); // again, now that the variables are doubles and divide as doubles
+        vector<double> vars;
+        env.toDoubles(vars);
+
+        volatile double sink = 0;
+        double tree = time_per_call(n, [&] { sink = bet.evaluate(env).asDouble(); });
+        double expected = sink;
+        double code = time_per_call(n, [&] { sink = vm.run(prog, vars.data()); });
+        bool same = (sink == expected) || (sink != sink && expected != expected);
+        ClosureTree fn;
+        double closure = 0;
+        if (fn.compile(prog)) {
+            closure = time_per_call(n, [&] { sink = fn.run(vars.data()); });
+            same = same && ((sink == expected) || (sink != sink && expected != expected));
+        }
+        JitProgram jit;
+        double native = 0;
+        if (jit.compile(prog)) {
+            JitProgram::Fn f = jit.entry();
+            native = time_per_call(n, [&] { sink = f(vars.data()); });
+            same = same && ((sink == expected) || (sink != sink && expected != expected));
+        }
+
+        // one column per variable, every row slightly different
+        vector<vector<double> > table(env.size(), vector<double>(ROWS));
+        vector<const double *> columns(env.size());
+        for (size_t s = 0; s < env.size(); s++) {
+            for (size_t r = 0; r < ROWS; r++) {
+                table[s][r] = vars[s] + 0.001 * r;
+            }
+            columns[s] = table[s].data();
+        }
+        vector<double> rowResult(ROWS), batchResult(ROWS), row(env.size());
+        BatchEvaluator batch;
+        long reps = max(1L, n / (long) ROWS);
+        double rowwise = time_per_call(reps, [&] {
+            for (size_t r = 0; r < ROWS; r++) {
+                for (size_t s = 0; s < row.size(); s++) {
+                    row[s] = columns[s][r];
+                }
+                rowResult[r] = vm.run(prog, row.data());
+            }
+        }) / ROWS;
+        double batched = time_per_call(reps, [&] {
+            batch.run(prog, columns.data(), ROWS, batchResult.data());
+        }) / ROWS;
+        for (size_t r = 0; r < ROWS; r++) {
+            if (!(rowResult[r] == batchResult[r] || (rowResult[r] != rowResult[r] && batchResult[r] != batchResult[r]))) {
+                same = false;
+            }
+        }
+
+        cout << "Expression: ";
+        bet.printPostfixExpression();
+        cout << "  nodes " << bet.size()
+             << fixed << setprecision(2)
+             << "  tree " << tree << " ns"
+             << "  bytecode " << code << " ns"
+             << "  speedup " << tree / code << "x";
+        if (!fn.empty()) {
+            cout << "  closure " << closure << " ns"
+                 << "  speedup " << tree / closure << "x";
+        }
+        if (jit.entry() != nullptr) {
+            cout << "  jit " << native << " ns"
+                 << "  speedup " << tree / native << "x";
+        }
+        cout << endl
+             << "  per row: vm " << rowwise << " ns"
+             << "  batch " << batched << " ns"
+             << "  speedup " << rowwise / batched << "x"
+             << defaultfloat << setprecision(6)
+             << (same ? "" : "  RESULT MISMATCH") << endl;
+        if (!same) {
+            mismatches++;
+        }
+    } while (ret > SYM_NULL);
+
+    return mismatches == 0 ? 0 : 1;
+}
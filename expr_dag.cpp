@@ -0,0 +1,158 @@
+#include <algorithm>
+
+#include "expr_dag.h"
+
+using namespace std;
+
+/*
+ * builds an empty DAG.
+ */
+ExprDag::ExprDag()
+        : boundEnv{0}, boundNodes{0}, stamp{0}
+{
+}
+
+/*
+ * id of the leaf for an operand token. Leaves are keyed on their class and
+ * exact lexeme, so "5" and "5.0" stay different nodes.
+ */
+uint32_t ExprDag::leaf(const Token & tok)
+{
+    return intern(Node{(uint8_t) tok.getType(), NONE, NONE, names.intern(tok.view().str())}, Value::of(tok), 1);
+}
+
+/*
+ * id of the node applying op to the nodes left and right.
+ */
+uint32_t ExprDag::node(int op, uint32_t left, uint32_t right)
+{
+    return intern(Node{(uint8_t) op, left, right, NONE}, Value(), 1 + treeSizes[left] + treeSizes[right]);
+}
+
+/*
+ * number of distinct nodes in the DAG
+ */
+size_t ExprDag::size() const
+{
+    return nodes.size();
+}
+
+/*
+ * number of nodes the expression rooted at root has when every shared
+ * node is counted once per use, i.e. the size of the equivalent tree.
+ */
+uint64_t ExprDag::treeSize(uint32_t root) const
+{
+    return root < treeSizes.size() ? treeSizes[root] : 0;
+}
+
+/*
+ * remove every node
+ */
+void ExprDag::clear()
+{
+    nodes.clear();
+    literals.clear();
+    treeSizes.clear();
+    slots.clear();
+    ids.clear();
+    names.clear();
+    boundEnv = 0;
+    boundNodes = 0;
+}
+
+/*
+ * value of the expression rooted at root. Only the nodes reachable from
+ * root are computed: a depth-first walk lists them children first, and
+ * every node is listed and computed once no matter how many parents share
+ * it. The other expressions in the DAG are not touched.
+ */
+Value ExprDag::evaluate(uint32_t root, Environment & env)
+{
+    if (root >= nodes.size()) {
+        return Value();
+    }
+    bind(env);
+    if (values.size() < nodes.size()) {
+        values.resize(nodes.size());
+        visited.resize(nodes.size(), 0);
+    }
+    if (++stamp == 0) {
+        // the stamps wrapped around: forget every earlier visit
+        fill(visited.begin(), visited.end(), 0);
+        stamp = 1;
+    }
+
+    // a node is pushed with its low bit clear, and again with it set once
+    // its children have been pushed above it
+    order.clear();
+    pending.assign(1, (uint64_t) root << 1);
+    while (!pending.empty()) {
+        uint64_t top = pending.back();
+        uint32_t id = (uint32_t) (top >> 1);
+        pending.pop_back();
+        if (visited[id] == stamp) {
+            continue;
+        }
+        const Node & n = nodes[id];
+        if ((top & 1) != 0 || n.left == NONE) {
+            visited[id] = stamp;
+            order.push_back(id);
+            continue;
+        }
+        pending.push_back(top | 1);
+        if (visited[n.right] != stamp) {
+            pending.push_back((uint64_t) n.right << 1);
+        }
+        if (visited[n.left] != stamp) {
+            pending.push_back((uint64_t) n.left << 1);
+        }
+    }
+
+    for (uint32_t i : order) {
+        const Node & n = nodes[i];
+        if (n.left == NONE) {
+            values[i] = slots[i] >= 0 ? env.get(slots[i]) : literals[i];
+        } else {
+            values[i] = Value::apply(n.op, values[n.left], values[n.right]);
+        }
+    }
+    return values[root];
+}
+
+/*
+ * the id of n, creating it with the given literal and tree size if no
+ * equal node exists yet.
+ */
+uint32_t ExprDag::intern(const Node & n, const Value & literal, uint64_t size)
+{
+    auto it = ids.find(n);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    uint32_t id = (uint32_t) nodes.size();
+    nodes.push_back(n);
+    literals.push_back(literal);
+    treeSizes.push_back(size);
+    slots.push_back(-1);
+    ids.emplace(n, id);
+    return id;
+}
+
+/*
+ * resolve the variable leaves to slots of env. Only nodes added since the
+ * last call are looked at, unless env is a different environment.
+ */
+void ExprDag::bind(Environment & env)
+{
+    if (boundEnv != env.id()) {
+        boundEnv = env.id();
+        boundNodes = 0;
+    }
+    for (; boundNodes < nodes.size(); boundNodes++) {
+        const Node & n = nodes[boundNodes];
+        if (n.op == SYM_NAME) {
+            slots[boundNodes] = env.slot(string(names.view(n.lex)));
+        }
+    }
+}
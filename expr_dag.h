@@ -0,0 +1,82 @@
+#ifndef PROJ04SRC_EXPR_DAG_H
+#define PROJ04SRC_EXPR_DAG_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "environment.h"
+
+/*
+ * Expression DAG built by hash-consing: a node is only created if no node
+ * with the same (opcode, children, literal) exists yet, so identical
+ * subtrees are stored once and shared. In "a b + a b + *" both "a b +"
+ * are the same node.
+ *
+ * Node ids are handed out in creation order and children are always
+ * created before their parents. One DAG can hold several expressions
+ * (BET::toDag returns the id of each root); they then share their common
+ * subexpressions too. Evaluating one of them computes each node reachable
+ * from its root exactly once, and nothing else.
+ */
+class ExprDag {
+public:
+    static const uint32_t NONE = 0xffffffffu; // child id of a leaf
+
+    ExprDag();
+
+    uint32_t leaf(const Token & tok); //id of the leaf for the operand token (SYM_NAME, SYM_INTEG or SYM_FLOAT)
+    uint32_t node(int op, uint32_t left, uint32_t right); //id of the node applying op (SYM_ADD .. SYM_DIV) to two existing nodes
+
+    size_t size() const; //number of distinct nodes in the DAG
+    uint64_t treeSize(uint32_t root) const; //number of nodes the expression rooted at root has as a tree
+    void clear(); //remove every node
+
+    Value evaluate(uint32_t root, Environment & env); //value of the expression rooted at root, every node computed once
+
+private:
+    struct Node {
+        uint8_t op;     // SYM_* class of the node
+        uint32_t left;  // child ids, NONE for leaves
+        uint32_t right;
+        uint32_t lex;   // id of the lexeme of a leaf in names, NONE for operators
+    };
+
+    struct KeyHash {
+        size_t operator()(const Node & n) const
+        {
+            uint64_t h = n.op;
+            h = h * 0x9e3779b97f4a7c15ull + n.left;
+            h = h * 0x9e3779b97f4a7c15ull + n.right;
+            h = h * 0x9e3779b97f4a7c15ull + n.lex;
+            return (size_t) (h ^ (h >> 29));
+        }
+    };
+
+    struct KeyEqual {
+        bool operator()(const Node & a, const Node & b) const
+        {
+            return a.op == b.op && a.left == b.left && a.right == b.right && a.lex == b.lex;
+        }
+    };
+
+    uint32_t intern(const Node & n, const Value & literal, uint64_t size); //the id of n, creating it if new
+    void bind(Environment & env); //resolve the variable leaves to slots of env
+
+    std::vector<Node> nodes;          // all nodes, in creation (topological) order
+    std::vector<Value> literals;      // parsed value of number leaves
+    std::vector<uint64_t> treeSizes;  // tree size of the subexpression of every node
+    std::vector<int> slots;           // variable slot of name leaves, -1 otherwise
+    Lexicon names;                    // lexemes of the leaves
+    std::vector<Value> values;        // evaluation scratch, one value per node
+    std::vector<uint32_t> visited;    // evaluation scratch: stamp of the last evaluation that reached each node
+    std::vector<uint32_t> order;      // evaluation scratch: the nodes reachable from the root, children first
+    std::vector<uint64_t> pending;    // evaluation scratch: walk stack, node id << 1 | children pushed
+    std::unordered_map<Node, uint32_t, KeyHash, KeyEqual> ids; // hash-consing table
+    uint64_t boundEnv;   // Environment the slots belong to
+    size_t boundNodes;   // nodes whose slot has been resolved
+    uint32_t stamp;      // of the current evaluation in visited
+};
+
+#endif //PROJ04SRC_EXPR_DAG_H
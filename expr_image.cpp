@@ -0,0 +1,276 @@
+#include <cstdio>
+#include <cstring>
+
+#include "expr_image.h"
+
+static const char IMAGE_MAGIC[8] = {'B', 'E', 'T', 'I', 'M', 'G', 0, 0};
+
+/*
+ * round n up to a multiple of 8.
+ */
+static uint64_t align8(uint64_t n)
+{
+    return (n + 7) & ~(uint64_t) 7;
+}
+
+//############## ExprImageWriter ###########################
+
+/*
+ * append the next token of the current expression. Numbers are parsed
+ * into the literal pool the first time their lexeme is seen.
+ */
+void ExprImageWriter::add(const Token & tok)
+{
+    int cls = tok.getType();
+    uint32_t sym = symbol(tok.view().str());
+    uint32_t arg = sym;
+    if (cls == SYM_INTEG || cls == SYM_FLOAT) {
+        auto it = literalIndex.find(sym);
+        if (it == literalIndex.end()) {
+            Value v = Value::of(tok);
+            ImageLiteral lit;
+            if (v.isInt) {
+                lit.i = v.i;
+            } else {
+                lit.d = v.d;
+            }
+            lit.symbol = sym;
+            lit.isInt = v.isInt;
+            it = literalIndex.emplace(sym, (uint32_t) literals.size()).first;
+            literals.push_back(lit);
+        }
+        arg = it->second;
+    }
+    code.push_back((uint32_t) cls | arg << 8);
+}
+
+/*
+ * close the current expression: the tokens added since the last call
+ * make one expression.
+ */
+void ExprImageWriter::endExpression()
+{
+    uint32_t first = exprs.empty() ? 0 : exprs.back().first + exprs.back().count;
+    exprs.push_back(ImageExpr{first, (uint32_t) code.size() - first});
+}
+
+uint32_t ExprImageWriter::symbol(std::string_view lexeme)
+{
+    auto it = symbolIndex.find(std::string(lexeme));
+    if (it != symbolIndex.end())
+        return it->second;
+    uint32_t s = (uint32_t) symbols.size();
+    symbols.push_back(ImageSymbol{(uint32_t) text.size(), (uint32_t) lexeme.size()});
+    text.append(lexeme);
+    symbolIndex.emplace(std::string(lexeme), s);
+    return s;
+}
+
+/*
+ * write the header and the sections to path.
+ */
+bool ExprImageWriter::save(const char * path) const
+{
+    ImageHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, IMAGE_MAGIC, sizeof(h.magic));
+    h.version = IMAGE_VERSION;
+    h.byteOrder = IMAGE_BYTE_ORDER;
+    h.expressions = (uint32_t) exprs.size();
+    h.codeUnits = (uint32_t) code.size();
+    h.literals = (uint32_t) literals.size();
+    h.symbols = (uint32_t) symbols.size();
+    h.textBytes = text.size();
+    h.exprOffset = align8(sizeof(h));
+    h.codeOffset = align8(h.exprOffset + exprs.size() * sizeof(ImageExpr));
+    h.literalOffset = align8(h.codeOffset + code.size() * sizeof(uint32_t));
+    h.symbolOffset = align8(h.literalOffset + literals.size() * sizeof(ImageLiteral));
+    h.textOffset = align8(h.symbolOffset + symbols.size() * sizeof(ImageSymbol));
+    h.fileSize = h.textOffset + text.size();
+
+    std::vector<char> image(h.fileSize, 0);
+    memcpy(&image[0], &h, sizeof(h));
+    auto put = [&](uint64_t at, const void * data, size_t bytes) {
+        if (bytes > 0)
+            memcpy(&image[at], data, bytes);
+    };
+    put(h.exprOffset, exprs.data(), exprs.size() * sizeof(ImageExpr));
+    put(h.codeOffset, code.data(), code.size() * sizeof(uint32_t));
+    put(h.literalOffset, literals.data(), literals.size() * sizeof(ImageLiteral));
+    put(h.symbolOffset, symbols.data(), symbols.size() * sizeof(ImageSymbol));
+    put(h.textOffset, text.data(), text.size());
+
+    FILE * f = fopen(path, "wb");
+    if (f == nullptr)
+        return false;
+    bool ok = fwrite(image.data(), 1, image.size(), f) == image.size();
+    return fclose(f) == 0 && ok;
+}
+
+//############## ExprImage ###########################
+
+/*
+ * map the image at path and check all of it, so that nothing read from
+ * it later can go out of bounds. Return false, with the reason in error,
+ * if it is not a valid image of this version.
+ */
+bool ExprImage::open(const char * path, std::string & error)
+{
+    header = nullptr;
+    tokens.clear();
+    if (!file.open(path))
+        return fail(error, "cannot be mapped");
+    if (file.size() < sizeof(ImageHeader))
+        return fail(error, "too short for an image");
+    header = (const ImageHeader *) file.begin();
+    if (memcmp(header->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0)
+        return fail(error, "not an expression image");
+    if (header->byteOrder != IMAGE_BYTE_ORDER)
+        return fail(error, "written in another byte order");
+    if (header->version != IMAGE_VERSION)
+        return fail(error, "written in another version of the format");
+    return check(error);
+}
+
+bool ExprImage::fail(std::string & error, const char * why)
+{
+    error = why;
+    header = nullptr;
+    file.close();
+    return false;
+}
+
+/*
+ * the sections lie within the file, every index is in range and every
+ * expression is a complete postfix expression. Tokens are made for the
+ * literals and symbols the code uses, once each.
+ */
+bool ExprImage::check(std::string & error)
+{
+    const ImageHeader & h = *header;
+    uint64_t size = file.size();
+    auto fits = [&](uint64_t offset, uint64_t count, uint64_t each) {
+        return offset % 8 == 0 && offset <= size && count <= (size - offset) / each;
+    };
+    if (h.fileSize != size || !fits(h.exprOffset, h.expressions, sizeof(ImageExpr)) ||
+        !fits(h.codeOffset, h.codeUnits, sizeof(uint32_t)) ||
+        !fits(h.literalOffset, h.literals, sizeof(ImageLiteral)) ||
+        !fits(h.symbolOffset, h.symbols, sizeof(ImageSymbol)) || !fits(h.textOffset, h.textBytes, 1))
+        return fail(error, "sections do not fit in the file");
+
+    const char * base = file.begin();
+    exprs = (const ImageExpr *) (base + h.exprOffset);
+    code = (const uint32_t *) (base + h.codeOffset);
+    literals = (const ImageLiteral *) (base + h.literalOffset);
+    symbols = (const ImageSymbol *) (base + h.symbolOffset);
+    text = base + h.textOffset;
+
+    for (uint32_t s = 0; s < h.symbols; s++) {
+        if (symbols[s].offset > h.textBytes || symbols[s].length > h.textBytes - symbols[s].offset)
+            return fail(error, "symbol outside the text");
+    }
+    for (uint32_t l = 0; l < h.literals; l++) {
+        if (literals[l].symbol >= h.symbols)
+            return fail(error, "literal without a symbol");
+    }
+
+    // the tokens are those of the literals, then those of the symbols; a
+    // unit of class c is token tokenBase[c] + its index, which must be
+    // below limit[c]; it changes the depth of the stack by effect[c]
+    uint32_t limit[SYM_ENDLN];
+    long effect[SYM_ENDLN];
+    for (int c = 0; c < SYM_ENDLN; c++) {
+        bool number = c == SYM_INTEG || c == SYM_FLOAT;
+        tokenBase[c] = number ? 0 : h.literals;
+        limit[c] = c == SYM_NULL ? 0 : number ? h.literals : h.symbols;
+        effect[c] = c >= SYM_OPCODE ? -1 : 1;
+    }
+    tokens.assign((size_t) h.literals + h.symbols, Token());
+    std::vector<uint8_t> classes(tokens.size(), SYM_NULL);
+
+    // the expressions follow each other through the code; in one pass each
+    // is checked to be a single tree, and each token gets the class of the
+    // first unit using it
+    uint32_t end = 0;
+    for (uint32_t e = 0; e < h.expressions; e++) {
+        const ImageExpr & x = exprs[e];
+        if (x.first != end || x.count > h.codeUnits - end)
+            return fail(error, "expressions out of order");
+        end += x.count;
+        long depth = 0;
+        for (uint32_t i = x.first; i < end; i++) {
+            uint32_t cls = code[i] & 0xff;
+            uint32_t arg = code[i] >> 8;
+            if (cls >= SYM_ENDLN || arg >= limit[cls])
+                return fail(error, "token outside its table");
+            uint32_t t = tokenBase[cls] + arg;
+            if (classes[t] != cls) {
+                if (classes[t] != SYM_NULL)
+                    return fail(error, "symbol used as two kinds of token");
+                classes[t] = (uint8_t) cls;
+                tokens[t] = Token(lexeme(code[i]), cls);
+            }
+            depth += effect[cls]; // a table, not a branch: operators and operands alternate unpredictably
+            if (depth < 1)
+                return fail(error, "operator without two operands");
+        }
+        if (depth != 1)
+            return fail(error, "expression is not a single tree");
+    }
+    if (end != h.codeUnits)
+        return fail(error, "code outside the expressions");
+    return true;
+}
+
+std::string_view ExprImage::lexeme(uint32_t unit) const
+{
+    int cls = unit & 0xff;
+    uint32_t sym = cls == SYM_INTEG || cls == SYM_FLOAT ? literals[unit >> 8].symbol : unit >> 8;
+    return std::string_view(text + symbols[sym].offset, symbols[sym].length);
+}
+
+/*
+ * print expression e in postfix, straight from the image.
+ */
+void ExprImage::printPostfix(size_t e, std::ostream & out) const
+{
+    const ImageExpr & x = exprs[e];
+    for (uint32_t i = x.first; i < x.first + x.count; i++)
+        out << lexeme(code[i]) << " ";
+    out << endl;
+}
+
+/*
+ * translate expression e into bytecode straight from the image, without
+ * building a tree: the code units are in postfix order already. Variables
+ * get slots of env, and integer division and multiplication become OP_IDIV
+ * and OP_IMUL as in BET::compile, valid while env.fits(prog). Return false
+ * if there is no expression e.
+ */
+bool ExprImage::compile(size_t e, Program & prog, Environment & env) const
+{
+    prog.clear();
+    if (e >= size())
+        return false;
+    const ImageExpr & x = exprs[e];
+    std::vector<bool> integer;
+    for (uint32_t i = x.first; i < x.first + x.count; i++) {
+        int cls = code[i] & 0xff;
+        uint32_t arg = code[i] >> 8;
+        if (cls == SYM_NAME) {
+            int slot = env.slot(std::string(lexeme(code[i])));
+            integer.push_back(env.get(slot).isInt);
+            prog.emitVar(slot, integer.back());
+        } else if (cls == SYM_INTEG || cls == SYM_FLOAT) {
+            prog.emitConst(literals[arg].isInt ? (double) literals[arg].i : literals[arg].d);
+            integer.push_back(literals[arg].isInt);
+        } else {
+            bool both = integer[integer.size() - 2] && integer.back();
+            integer.pop_back();
+            integer.back() = both;
+            prog.emitOp(arithOp(cls, both));
+        }
+    }
+    prog.emitRet();
+    return true;
+}
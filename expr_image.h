@@ -0,0 +1,149 @@
+#ifndef PROJ04SRC_EXPR_IMAGE_H
+#define PROJ04SRC_EXPR_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "opnum.h"
+#include "token.h"
+#include "mapped_file.h"
+#include "bytecode.h"
+#include "environment.h"
+
+/*
+ * A library of expressions in a versioned binary file, saved once and
+ * then mapped into memory and used in place on every later start, with
+ * nothing to lex.
+ *
+ * The file is a header followed by sections, each aligned to 8 bytes:
+ *   expressions  ImageExpr per expression: its range of code units; the
+ *                ranges follow each other and cover the code
+ *   code         one 32-bit unit per token, in postfix order: the token
+ *                class (SYM_*) in the low 8 bits and an index above it,
+ *                into the literals for numbers, into the symbols otherwise
+ *   literals     ImageLiteral per distinct number: its value, parsed
+ *                once when the file was written, and its symbol
+ *   symbols      ImageSymbol per distinct lexeme: where its text is
+ *   text         the lexemes, back to back
+ * All integers are in the byte order of the machine that wrote the file;
+ * a file from a machine of the other order is refused, as is any other
+ * version of the format.
+ */
+
+static const uint32_t IMAGE_VERSION = 1;
+static const uint32_t IMAGE_BYTE_ORDER = 0x01020304; // reads differently in the other byte order
+
+struct ImageHeader {
+    char magic[8];           // "BETIMG" and two zero bytes
+    uint32_t version;        // IMAGE_VERSION
+    uint32_t byteOrder;      // IMAGE_BYTE_ORDER
+    uint32_t expressions;    // entries of each section
+    uint32_t codeUnits;
+    uint32_t literals;
+    uint32_t symbols;
+    uint64_t textBytes;
+    uint64_t exprOffset;     // where each section starts, from the start of the file
+    uint64_t codeOffset;
+    uint64_t literalOffset;
+    uint64_t symbolOffset;
+    uint64_t textOffset;
+    uint64_t fileSize;       // bytes in the whole file
+};
+
+struct ImageExpr {
+    uint32_t first; // first code unit
+    uint32_t count; // number of code units
+};
+
+struct ImageLiteral {
+    union {
+        int64_t i;
+        double d;
+    };
+    uint32_t symbol; // the lexeme
+    uint32_t isInt;  // 1 if the value is in i
+};
+
+struct ImageSymbol {
+    uint32_t offset; // into the text
+    uint32_t length;
+};
+
+/*
+ * Collects expressions, one token at a time in postfix order, and saves
+ * them as an image. Equal lexemes are stored once.
+ */
+class ExprImageWriter {
+public:
+    void add(const Token & tok); //append the next token of the current expression
+    void endExpression(); //close the current expression
+    size_t size() const { return exprs.size(); } //expressions closed so far
+    bool save(const char * path) const; //write the image to path. Return false if it cannot be written.
+
+private:
+    uint32_t symbol(std::string_view lexeme); //index of lexeme in the symbols, added if new
+
+    std::vector<ImageExpr> exprs;
+    std::vector<uint32_t> code;
+    std::vector<ImageLiteral> literals;
+    std::vector<ImageSymbol> symbols;
+    std::string text;
+    std::unordered_map<std::string, uint32_t> symbolIndex;
+    std::unordered_map<uint32_t, uint32_t> literalIndex; // symbol -> literal
+};
+
+/*
+ * An image mapped read-only into memory. open() checks the whole file
+ * once; after that every expression can be printed or compiled to
+ * bytecode straight from the mapping, or fed to a tree builder without
+ * lexing. Numbers keep the value they were written with.
+ */
+class ExprImage {
+public:
+    ExprImage() : header{nullptr}, exprs{nullptr}, code{nullptr}, literals{nullptr}, symbols{nullptr}, text{nullptr} { }
+
+    ExprImage(const ExprImage &) = delete;
+    ExprImage & operator= (const ExprImage &) = delete;
+
+    bool open(const char * path, std::string & error); //map and check the image at path. Return false, with the reason in error, if it is not a valid image.
+    size_t size() const { return header != nullptr ? header->expressions : 0; } //number of expressions
+    size_t length(size_t e) const { return exprs[e].count; } //number of tokens in expression e
+
+    void printPostfix(size_t e, std::ostream & out = std::cout) const; //print expression e as BET::printPostfixExpression does
+    bool compile(size_t e, Program & prog, Environment & env) const; //bytecode of expression e, as BET::compile makes it
+
+    /*
+     * push the tokens of expression e to builder (a postfix builder of a
+     * BET or FlatBET, or anything else with push(const Token &)).
+     */
+    template <typename Builder>
+    void build(size_t e, Builder & builder) const
+    {
+        const ImageExpr & x = exprs[e];
+        for (uint32_t i = x.first; i < x.first + x.count; i++)
+            builder.push(tokenOf(code[i]));
+    }
+
+private:
+    bool fail(std::string & error, const char * why); //drop the mapping and set error
+    bool check(std::string & error); //check the sections and make the tokens
+    std::string_view lexeme(uint32_t unit) const; //text of a code unit
+    const Token & tokenOf(uint32_t unit) const { return tokens[tokenBase[unit & 0xff] + (unit >> 8)]; } //the token of a code unit
+
+    MappedFile file;
+    const ImageHeader * header;
+    const ImageExpr * exprs;
+    const uint32_t * code;
+    const ImageLiteral * literals;
+    const ImageSymbol * symbols;
+    const char * text;
+    std::vector<Token> tokens;      // token of every literal, then of every symbol
+    uint32_t tokenBase[SYM_ENDLN];  // where the tokens of each class of code unit start
+};
+
+#endif //PROJ04SRC_EXPR_IMAGE_H
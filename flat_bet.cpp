@@ -0,0 +1,468 @@
+#include <algorithm>
+#include <cstring>
+
+#include "flat_bet.h"
+#include "expr_image.h"
+#include "infix_builder.h"
+
+using namespace std;
+
+//############## Public Functions ###########################
+
+/*
+ * default zero-parameter constructor.
+ * Builds an empty tree.
+ */
+FlatBET::FlatBET()
+        : statsValid{false}
+{
+}
+
+/*
+ * one-parameter constructor, builds the tree of the postfix expression.
+ */
+FlatBET::FlatBET(const list<Token> & postfix)
+        : statsValid{false}
+{
+    buildFromPostfix(postfix);
+}
+
+/*
+ * copy constructor -- every column is trivially copyable, so each one
+ * is copied with a single memcpy.
+ */
+FlatBET::FlatBET(const FlatBET & t)
+        : links{t.links}, kinds{t.kinds}, offsets{t.offsets}, text{t.text},
+          profile{t.profile}, cachedStats{t.cachedStats}, statsValid{t.statsValid}
+{
+}
+
+/*
+ * move constructor -- takes over every column in O(1), leaving t empty.
+ */
+FlatBET::FlatBET(FlatBET && t) noexcept
+        : statsValid{false}
+{
+    swap(t);
+}
+
+/*
+ * Same contract as BET::buildFromPostfix.
+ */
+bool FlatBET::buildFromPostfix(const list<Token> & postfix, std::ostream & out)
+{
+    Builder builder(*this, out);
+    for (auto itr = postfix.begin(); itr != postfix.end(); itr++) {
+        builder.push(*itr);
+    }
+    return builder.finish();
+}
+
+/*
+ * Same contract as BET::buildFromInfix.
+ */
+bool FlatBET::buildFromInfix(const list<Token> & infix, std::ostream & out)
+{
+    InfixBuilder<FlatBET> builder(*this, out);
+    for (auto itr = infix.begin(); itr != infix.end(); itr++) {
+        builder.push(*itr);
+    }
+    return builder.finish();
+}
+
+/*
+ * assignment operator -- copies every column.
+ */
+const FlatBET & FlatBET::operator= (const FlatBET & t)
+{
+    if (this == &t)  // check for self-assignment
+        return *this;
+
+    links = t.links;
+    kinds = t.kinds;
+    offsets = t.offsets;
+    text = t.text;
+    profile = t.profile;
+    cachedStats = t.cachedStats;
+    statsValid = t.statsValid;
+    return *this;
+}
+
+/*
+ * move assignment -- drops the current tree and takes over the columns of
+ * t in O(1). t is left empty, holding the columns this tree used to have.
+ */
+const FlatBET & FlatBET::operator= (FlatBET && t) noexcept
+{
+    if (this == &t)
+        return *this;
+
+    makeEmpty();
+    swap(t);
+    return *this;
+}
+
+/*
+ * exchange the columns of this and t in O(1).
+ */
+void FlatBET::swap(FlatBET & t) noexcept
+{
+    links.swap(t.links);
+    kinds.swap(t.kinds);
+    offsets.swap(t.offsets);
+    text.swap(t.text);
+    levels.swap(t.levels);
+    profile.swap(t.profile);
+    std::swap(cachedStats, t.cachedStats);
+    std::swap(statsValid, t.statsValid);
+}
+
+/*
+ * Print out the infix expression to out.
+ */
+void FlatBET::printInfixExpression(std::ostream & out)
+{
+    if (!empty())
+        printInfixExpression((uint32_t) kinds.size() - 1, out);
+    out << endl;
+}
+
+/*
+ * Print the postfix form of the expression to out. The columns already are in
+ * postfix order, so this is a single pass over them.
+ */
+void FlatBET::printPostfixExpression(std::ostream & out)
+{
+    for (uint32_t i = 0; i < kinds.size(); i++) {
+        printLexeme(i, out);
+        out << " ";
+    }
+    out << endl;
+}
+
+/*
+ * Return the number of nodes in the tree.
+ */
+size_t FlatBET::size()
+{
+    return kinds.size();
+}
+
+/*
+ * Return the number of leaf nodes in the tree. (from the cached statistics)
+ */
+int FlatBET::leaves()
+{
+    return stats().leaves;
+}
+
+/*
+ * return the depth of the tree. (from the cached statistics)
+ */
+int FlatBET::depth()
+{
+    return stats().depth;
+}
+
+/*
+ * return the breadth of the tree. (from the cached statistics)
+ */
+int FlatBET::breadth()
+{
+    return stats().breadth;
+}
+
+/*
+ * return the size, leaf count, depth and breadth of the tree, cached until
+ * the tree changes. Parents come after their children, so one backward
+ * scan gives every node its level, which is all four need.
+ */
+const TreeStats & FlatBET::stats()
+{
+    if (statsValid)
+        return cachedStats;
+
+    TreeStats st;
+    st.size = kinds.size();
+    levels.assign(links.size(), 0);
+    profile.clear();
+    for (size_t i = links.size(); i-- > 0;) {
+        const Links & l = links[i];
+        int level = levels[i];
+        if ((size_t) level == profile.size())
+            profile.push_back(0);
+        profile[level]++;
+        if (l.left == NONE && l.right == NONE) {
+            st.leaves++;
+            continue;
+        }
+        if (l.left != NONE)
+            levels[l.left] = level + 1;
+        if (l.right != NONE)
+            levels[l.right] = level + 1;
+    }
+    st.depth = (int) profile.size() - 1;
+    for (int w : profile)
+        st.breadth = max(st.breadth, w);
+    cachedStats = st;
+    statsValid = true;
+    return cachedStats;
+}
+
+/*
+ * return the number of nodes at every depth, the root's level first;
+ * computed and cached with stats().
+ */
+const vector<int> & FlatBET::levelProfile()
+{
+    stats();
+    return profile;
+}
+
+/*
+ * return true if the tree is empty.
+ * Return false otherwise
+ */
+bool FlatBET::empty()
+{
+    return kinds.empty();
+}
+
+/*
+ * append the expression to image as one postfix expression: the nodes
+ * are in postfix order already. Return false (and add nothing) if the
+ * tree is empty.
+ */
+bool FlatBET::save(ExprImageWriter & image)
+{
+    if (kinds.empty()) {
+        return false;
+    }
+    for (uint32_t i = 0; i < kinds.size(); i++) {
+        image.add(Token(std::string_view(text.data() + offsets[i], offsets[i + 1] - offsets[i]), kinds[i]));
+    }
+    image.endExpression();
+    return true;
+}
+
+/*
+ * drop all nodes; the columns keep their capacity for the next build.
+ */
+void FlatBET::makeEmpty()
+{
+    statsValid = false;
+    links.clear();
+    kinds.clear();
+    offsets.clear();
+    text.clear();
+}
+
+//############## Builder ###########################
+
+/*
+ * a builder with no tree; start() gives it one.
+ */
+FlatBET::Builder::Builder()
+        : tree{nullptr}, out{&cout}, numOperators{0}, numOperands{0}, error{OK}, finished{true}
+{
+}
+
+/*
+ * empty tree and start building a new expression into it.
+ */
+FlatBET::Builder::Builder(FlatBET & t, std::ostream & o)
+        : Builder()
+{
+    start(t, o);
+}
+
+/*
+ * empty the tree if finish() was not called.
+ */
+FlatBET::Builder::~Builder()
+{
+    if (!finished)
+        tree->makeEmpty();
+}
+
+/*
+ * drop the expression being built, if finish() was not called for it,
+ * then empty t and start building a new expression into it.
+ */
+void FlatBET::Builder::start(FlatBET & t, std::ostream & o)
+{
+    if (!finished)
+        tree->makeEmpty();
+    tree = &t;
+    out = &o;
+    nodes.clear();
+    numOperators = 0;
+    numOperands = 0;
+    error = OK;
+    finished = false;
+    tree->makeEmpty();
+}
+
+/*
+ * add the next token. Tokens are appended to the columns in the order
+ * they arrive, so index i holds the i-th token of the expression and
+ * operator nodes only ever point backwards.
+ */
+void FlatBET::Builder::push(const Token & tok)
+{
+    if (error != OK)
+        return;
+    if (tok.getType() == SYM_NAME || tok.getType() == SYM_INTEG || tok.getType() == SYM_FLOAT) {
+        // operand: a leaf at the end of the columns
+        tree->append(tok, NONE, NONE);
+        nodes.push_back((uint32_t) tree->kinds.size() - 1);
+        numOperands++;
+    } else if (nodes.size() >= 2) {
+        // operator: its children are the two most recent subtrees
+        numOperators++;
+        uint32_t right = nodes.back();
+        nodes.pop_back();
+        uint32_t left = nodes.back();
+        nodes.pop_back();
+        tree->append(tok, left, right);
+        nodes.push_back((uint32_t) tree->kinds.size() - 1);
+    } else if (numOperators == numOperands) {
+        error = UNPAIRED;
+    } else if (numOperators < numOperands) {
+        error = ONE_OPERAND;
+    } else {
+        error = OTHER;
+    }
+}
+
+/*
+ * complete the tree: exactly one subtree must be left, and since it was
+ * appended last its root is the last node. Otherwise print the error
+ * message, empty the tree and return false.
+ */
+bool FlatBET::Builder::finish()
+{
+    finished = true;
+    if (error == OK && nodes.size() == 1)
+        return true;
+
+    if (error != OK) {
+        if (error == UNPAIRED) {
+            *out << "Error: Unpaired opcode ";
+        } else if (error == ONE_OPERAND) {
+            *out << "Error: Operator ";
+        } else {
+            *out << "Other error ";
+        }
+        if (!nodes.empty())
+            tree->printLexeme(nodes[0], *out);
+        if (error == ONE_OPERAND)
+            *out << " has only one operand ";
+        *out << endl;
+    } else if (nodes.size() > 1) {
+        if (numOperators == numOperands) {
+            *out << "Error: Operator ";
+            tree->printLexeme(nodes[0], *out);
+            *out << " has only one operand" << endl;
+        } else if (numOperators < numOperands) {
+            *out << "Error: Unpaired opcode ";
+            tree->printLexeme(nodes[0], *out);
+            *out << endl;
+        } else {
+            *out << "Other error ";
+            tree->printLexeme(nodes[0], *out);
+            *out << endl;
+        }
+    }
+    tree->makeEmpty();
+    return false;
+}
+
+/*
+ * drop the expression being built without finishing it, leaving the
+ * tree empty.
+ */
+void FlatBET::Builder::abandon()
+{
+    finished = true;
+    nodes.clear();
+    tree->makeEmpty();
+}
+
+//############## Private Functions ###########################
+
+/*
+ * add one node at the end of every column.
+ */
+void FlatBET::append(const Token & tok, uint32_t left, uint32_t right)
+{
+    Lexeme lexeme = tok.view();
+    std::string_view val = lexeme.str();
+    if (offsets.empty())
+        offsets.push_back(0); // start of the first lexeme
+    links.push_back(Links{left, right});
+    kinds.push_back((uint8_t) tok.getType());
+    text.insert(text.end(), val.begin(), val.end());
+    offsets.push_back((uint32_t) text.size());
+}
+
+/*
+ * print the lexeme of node n to out.
+ */
+void FlatBET::printLexeme(uint32_t n, std::ostream & out)
+{
+    out.write(text.data() + offsets[n], offsets[n + 1] - offsets[n]);
+}
+
+/*
+ * print to out the infix expression of the subtree rooted at n, with the same
+ * parenthesization rules as BET::printInfixExpression and, like it, with
+ * an explicit stack of frames instead of recursion.
+ */
+void FlatBET::printInfixExpression(uint32_t n, std::ostream & out)
+{
+    struct Frame {
+        uint32_t node;
+        int phase;    // 0: open and go left, 1: print and go right, 2: close
+        bool parens;
+    };
+    vector<Frame> frames;
+    frames.push_back(Frame{n, 0, false});
+    while (!frames.empty()) {
+        Frame & f = frames.back();
+        const Links & l = links[f.node];
+        if (f.phase == 0) {
+            f.phase = 1;
+            if (f.parens)
+                out << "(";
+            if (l.left != NONE)
+                frames.push_back(Frame{l.left, 0, priority(f.node, l.left)});
+        } else if (f.phase == 1) {
+            f.phase = 2;
+            printLexeme(f.node, out);
+            out << " ";
+            if (l.right != NONE)
+                frames.push_back(Frame{l.right, 0, priority(f.node, l.right) || priority2(f.node, l.right)});
+        } else {
+            if (f.parens)
+                out << ")";
+            frames.pop_back();
+        }
+    }
+}
+
+/*
+ * true if n2 binds looser than n1 (see OP_TABLE).
+ */
+bool FlatBET::priority(uint32_t n1, uint32_t n2)
+{
+    return precedence(kinds[n2]) < precedence(kinds[n1]);
+}
+
+/*
+ * true if n2, as the right child of n1, needs parentheses at equal precedence.
+ */
+bool FlatBET::priority2(uint32_t n1, uint32_t n2)
+{
+    return needsParens(kinds[n1], kinds[n2], true);
+}
@@ -0,0 +1,112 @@
+#ifndef PROJ04SRC_FLAT_BET_H
+#define PROJ04SRC_FLAT_BET_H
+
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <vector>
+#include "token.h"
+#include "optable.h"
+#include "tree_stats.h"
+
+class ExprImageWriter;
+
+/*
+ * Binary expression tree stored as columns instead of linked nodes.
+ *
+ * Nodes sit in one vector in postfix order (the order buildFromPostfix sees
+ * the tokens in), so the root is always the last node and both children of
+ * node i have indices smaller than i. Children are 32-bit indices, and the
+ * token class and lexeme of every node live in their own columns. A
+ * post-order walk is therefore a linear scan, and since every column is
+ * trivially copyable, copying a tree is one memcpy per column.
+ *
+ * The public interface mirrors BET so the two can be used interchangeably.
+ */
+class FlatBET {
+
+public:
+    class Builder; //builds a tree one postfix token at a time, like BET::Builder
+
+    FlatBET(); //builds an empty tree
+    FlatBET(const list<Token> & postfix); //builds the tree of the postfix expression
+    FlatBET(const FlatBET &); //copies every column
+    FlatBET(FlatBET &&) noexcept; //takes over every column in O(1), leaving the source empty
+    bool buildFromPostfix(const list<Token> & postfix, std::ostream & out = cout); //same contract and error messages as BET::buildFromPostfix
+    bool buildFromInfix(const list<Token> & infix, std::ostream & out = cout); //same contract and error messages as BET::buildFromInfix
+    const FlatBET & operator= (const FlatBET &); //copies every column
+    const FlatBET & operator= (FlatBET &&) noexcept; //drops this tree and takes over the columns of the source in O(1)
+    void swap(FlatBET &) noexcept; //exchange two trees in O(1)
+    void printInfixExpression(std::ostream & out = cout); //print out the infix expression to out
+    void printPostfixExpression(std::ostream & out = cout); //print the postfix form of the expression to out (a linear scan)
+    size_t size(); //return the number of nodes in the tree
+    int leaves(); //return the number of leaf nodes in the tree
+    int depth(); //return the depth of the tree
+    int breadth(); //return the breadth of the tree
+    const TreeStats & stats(); //size, leaves, depth and breadth from one scan, cached until the tree changes
+    const std::vector<int> & levelProfile(); //number of nodes at every depth, root first; computed and cached with stats()
+    bool empty(); //return true if the tree is empty. Return false otherwise
+    void makeEmpty(); //drop all nodes, keeping the column capacity
+    bool save(ExprImageWriter & image); //append the expression to image, like BET::save (a linear scan)
+
+private:
+    static const uint32_t NONE = 0xffffffffu; // child index of a missing child
+
+    struct Links {
+        uint32_t left;
+        uint32_t right;
+    };
+
+    std::vector<Links> links;      // child indices of every node
+    std::vector<uint8_t> kinds;    // token class (SYM_*) of every node
+    std::vector<uint32_t> offsets; // lexeme of node i is text[offsets[i], offsets[i+1]); empty until the first node
+    std::vector<char> text;        // all lexemes back to back, in postfix order
+    std::vector<int> levels;       // scratch: level of every node, filled by stats
+    std::vector<int> profile;      // node count of every level, valid with cachedStats
+    TreeStats cachedStats;         // result of the last stats() scan
+    bool statsValid;               // false once the tree changed since cachedStats was computed
+
+    void append(const Token & tok, uint32_t left, uint32_t right); //add one node at the end
+    void printLexeme(uint32_t n, std::ostream & out); //print the lexeme of node n to out
+    void printInfixExpression(uint32_t n, std::ostream & out); //print the infix expression of the subtree rooted at n to out
+    bool priority(uint32_t n1, uint32_t n2); //true if n2 binds looser than n1
+    bool priority2(uint32_t n1, uint32_t n2); //true if the right child n2 needs parentheses at equal precedence
+};
+
+/*
+ * Builds a FlatBET one postfix token at a time, with the same contract as
+ * BET::Builder: each token is appended to the columns as it arrives, and
+ * errors are reported by finish(). start() reuses the builder, keeping the
+ * capacity of its stack; the tree keeps that of its columns.
+ */
+class FlatBET::Builder {
+public:
+    Builder(); //a builder with no tree; call start() before push()
+    explicit Builder(FlatBET & tree, std::ostream & out = cout); //empty tree and start building into it; errors go to out
+    ~Builder(); //empty the tree if finish() was not called
+    Builder(const Builder &) = delete;
+    Builder & operator= (const Builder &) = delete;
+
+    void start(FlatBET & tree, std::ostream & out = cout); //drop any unfinished expression, empty tree and start building into it
+    void push(const Token & tok); //add the next token of the expression; tokens after an error are ignored
+    bool finish(); //complete the tree. Return true if it was built; otherwise write the error to out, leave the tree empty and return false.
+    void abandon(); //drop the expression instead of finishing it, leaving the tree empty and printing nothing
+
+private:
+    enum Error { OK, UNPAIRED, ONE_OPERAND, OTHER };
+
+    FlatBET * tree;              // tree being built
+    std::ostream * out;          // where finish() reports errors
+    std::vector<uint32_t> nodes; // indices of the subtrees built so far
+    int numOperators;
+    int numOperands;
+    Error error;                 // first error met, reported by finish()
+    bool finished;               // true once finish() ran, or before the first start()
+};
+
+inline void swap(FlatBET & a, FlatBET & b) noexcept //exchange two trees in O(1)
+{
+    a.swap(b);
+}
+
+#endif //PROJ04SRC_FLAT_BET_H
@@ -0,0 +1,159 @@
+#ifndef PROJ04SRC_INFIX_BUILDER_H
+#define PROJ04SRC_INFIX_BUILDER_H
+
+#include <iostream>
+#include <vector>
+
+#include "opnum.h"
+#include "optable.h"
+#include "token.h"
+
+/*
+ * Builds a tree from an infix expression one token at a time, with the
+ * shunting-yard algorithm: operands go straight to the tree's postfix
+ * Builder, and operators wait on a stack until everything that binds
+ * tighter than them has been built, so every node is created as soon as
+ * its operands are complete and no postfix list is ever formed.
+ * Precedence and associativity come from optable.h, parentheses are
+ * SYM_LPAREN and SYM_RPAREN. There are no unary operators: "-3" is an
+ * operator without a left operand.
+ *
+ * It has the same interface and contract as the postfix builders: the
+ * first error is held back until finish() prints it, and start() reuses
+ * the builder, keeping the capacity of its stacks.
+ *
+ * Tree is BET<Token> or FlatBET.
+ */
+template <typename Tree>
+class InfixBuilder {
+public:
+    InfixBuilder() : out{&std::cout}, expectOperand{true}, error{OK} { } //a builder with no tree; call start() before push()
+    explicit InfixBuilder(Tree & tree, std::ostream & out = std::cout) : InfixBuilder() { start(tree, out); } //empty tree and start building into it; errors go to out
+
+    InfixBuilder(const InfixBuilder &) = delete;
+    InfixBuilder & operator= (const InfixBuilder &) = delete;
+
+    /*
+     * drop any unfinished expression, empty tree and start building into it.
+     */
+    void start(Tree & tree, std::ostream & o = std::cout)
+    {
+        builder.start(tree, o);
+        out = &o;
+        ops.clear();
+        culpritText.clear();
+        expectOperand = true;
+        error = OK;
+    }
+
+    /*
+     * add the next token of the infix expression; tokens after an error are ignored.
+     */
+    void push(const Token & tok)
+    {
+        if (error != OK)
+            return;
+        int cls = tok.getType();
+        if (cls == SYM_NAME || cls == SYM_INTEG || cls == SYM_FLOAT) {
+            if (!expectOperand)
+                return fail(MISSING_OPERATOR, tok);
+            builder.push(tok);
+            expectOperand = false;
+        } else if (cls >= SYM_OPCODE && cls < SYM_ENDLN) {
+            if (expectOperand)
+                return fail(MISSING_OPERAND, tok);
+            // build the operators on the stack that take their right operand before this one
+            while (!ops.empty() && ops.back().getType() != SYM_LPAREN && buildsFirst(ops.back().getType(), cls)) {
+                builder.push(ops.back());
+                ops.pop_back();
+            }
+            ops.push_back(tok);
+            expectOperand = true;
+        } else if (cls == SYM_LPAREN) {
+            if (!expectOperand)
+                return fail(MISSING_OPERATOR, tok);
+            ops.push_back(tok);
+        } else if (cls == SYM_RPAREN) {
+            if (expectOperand)
+                return fail(MISSING_OPERAND, tok);
+            while (!ops.empty() && ops.back().getType() != SYM_LPAREN) {
+                builder.push(ops.back());
+                ops.pop_back();
+            }
+            if (ops.empty())
+                return fail(UNMATCHED, tok);
+            ops.pop_back();
+        } else {
+            fail(OTHER, tok);
+        }
+    }
+
+    /*
+     * complete the tree. Return true if it was built; otherwise write the
+     * error to out, leave the tree empty and return false. An empty
+     * expression builds nothing and prints nothing, as in postfix.
+     */
+    bool finish()
+    {
+        if (error == OK && expectOperand && !ops.empty()) {
+            // the expression ends after an operator or "("
+            fail(ops.back().getType() == SYM_LPAREN ? UNMATCHED : MISSING_OPERAND, ops.back());
+        }
+        while (error == OK && !ops.empty()) {
+            if (ops.back().getType() == SYM_LPAREN) {
+                fail(UNMATCHED, ops.back());
+            } else {
+                builder.push(ops.back());
+                ops.pop_back();
+            }
+        }
+        if (error == OK) {
+            return builder.finish();
+        }
+
+        if (error == MISSING_OPERAND && culprit.getType() != SYM_RPAREN) {
+            *out << "Error: Operator " << culprit.view() << " has only one operand";
+        } else if (error == MISSING_OPERAND) {
+            *out << "Error: Missing operand before " << culprit.view();
+        } else if (error == MISSING_OPERATOR) {
+            *out << "Error: Missing operator before " << culprit.view();
+        } else if (error == UNMATCHED) {
+            *out << "Error: Unmatched " << culprit.view();
+        } else {
+            *out << "Other error " << culprit.view();
+        }
+        *out << endl;
+        builder.abandon();
+        return false;
+    }
+
+private:
+    enum Error { OK, MISSING_OPERAND, MISSING_OPERATOR, UNMATCHED, OTHER };
+
+    /*
+     * true if the operator top, already on the stack, is built before an
+     * operator next that follows it: when top binds tighter, or as tight
+     * and next groups to the left.
+     */
+    static bool buildsFirst(int top, int next)
+    {
+        return precedence(top) > precedence(next) ||
+               (precedence(top) == precedence(next) && associativity(next) == ASSOC_LEFT);
+    }
+
+    void fail(Error e, const Token & tok)
+    {
+        error = e;
+        culprit = tok.storedIn(culpritText); // the lexer may move on before finish() prints it
+    }
+
+    typename Tree::Builder builder; // builds the tree from the operands and operators in postfix order
+    std::ostream * out;             // where finish() reports errors
+    std::vector<Token> ops;         // operators and "(" waiting for their right side
+    bool expectOperand;             // true where an operand or "(" must come next
+    Error error;                    // first error met, reported by finish()
+    Token culprit;                  // the token error was found at
+    Lexicon culpritText;            // keeps the lexeme of culprit if it is long
+};
+
+#endif //PROJ04SRC_INFIX_BUILDER_H
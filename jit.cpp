@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "jit.h"
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_X86_64 1
+#include <sys/mman.h>
+#else
+#define JIT_X86_64 0
+#endif
+
+bool JitProgram::native()
+{
+    return JIT_X86_64;
+}
+
+void JitProgram::release()
+{
+#if JIT_X86_64
+    if (code != nullptr)
+        munmap(code, length);
+#endif
+    code = nullptr;
+    length = 0;
+}
+
+#if JIT_X86_64
+
+namespace {
+
+const int REGS = 16; // xmm0 .. xmm15
+
+// second opcode byte of the scalar double instructions (F2 0F xx)
+const uint8_t MOVSD_LOAD = 0x10;
+const uint8_t MOVSD_STORE = 0x11;
+const uint8_t ADDSD = 0x58;
+const uint8_t MULSD = 0x59;
+const uint8_t SUBSD = 0x5C;
+const uint8_t DIVSD = 0x5E;
+
+uint8_t arith(Opcode op)
+{
+    switch (op) {
+        case OP_ADD: return ADDSD;
+        case OP_SUB: return SUBSD;
+        case OP_MUL:
+        case OP_IMUL: return MULSD;
+        default:      return DIVSD;
+    }
+}
+
+/*
+ * The expression tree rebuilt from postfix code, and the code generator
+ * over it.
+ */
+class Emitter {
+public:
+    struct Node {
+        Opcode op;    // OP_VAR, OP_CONST, or OP_ADD .. OP_IMUL
+        int left;     // children, -1 for leaves
+        int right;
+        uint32_t arg; // variable slot or constant index
+        int label;    // Sethi-Ullman number: registers needed to evaluate the subtree
+    };
+
+    /*
+     * rebuild the tree of prog. Return false if it is deeper than MAX_DEPTH.
+     */
+    bool build(const Program & prog)
+    {
+        consts = &prog.consts();
+        std::vector<int> stack;
+        std::vector<size_t> depths;
+        for (const Instr & ins : prog.code()) {
+            if (ins.op == OP_VAR || ins.op == OP_CONST) {
+                stack.push_back((int) nodes.size());
+                depths.push_back(0);
+                nodes.push_back(Node{ins.op, -1, -1, ins.arg, 1});
+            } else if (isArith(ins.op)) {
+                int r = stack.back();
+                stack.pop_back();
+                int l = stack.back();
+                size_t depth = 1 + std::max(depths[depths.size() - 1], depths[depths.size() - 2]);
+                depths.pop_back();
+                if (depth > JitProgram::MAX_DEPTH)
+                    return false;
+                depths.back() = depth;
+                // a right leaf is a memory operand and needs no register
+                int ll = nodes[l].label;
+                int lr = isLeaf(r) ? 0 : nodes[r].label;
+                nodes.push_back(Node{ins.op, l, r, 0, ll == lr ? ll + 1 : std::max(ll, lr)});
+                stack.back() = (int) nodes.size() - 1;
+            } else {
+                break; // OP_RET
+            }
+        }
+        root = stack.back();
+        return true;
+    }
+
+    /*
+     * the whole function: the value of the tree into xmm0, return, then
+     * the constants, a +0.0 for OP_IMUL and a NaN for OP_IDIV.
+     */
+    std::vector<uint8_t> & emit()
+    {
+        gen(root, 0);
+        out.push_back(0xC3); // ret
+        while (out.size() % 8 != 0)
+            out.push_back(0xCC);
+        size_t pool = out.size();
+        out.resize(pool + 8 * (consts->size() + 2)); // the +0.0 stays zero
+        if (!consts->empty())
+            memcpy(&out[pool], consts->data(), 8 * consts->size());
+        double nan = std::numeric_limits<double>::quiet_NaN();
+        memcpy(&out[pool + 8 * (consts->size() + 1)], &nan, 8);
+        for (const Fixup & f : fixups) {
+            int32_t disp = (int32_t) (pool + 8 * f.index - (f.at + 4));
+            memcpy(&out[f.at], &disp, 4);
+        }
+        return out;
+    }
+
+private:
+    struct Fixup {
+        size_t at;      // where the RIP-relative displacement goes
+        uint32_t index; // of the constant it addresses
+    };
+
+    bool isLeaf(int n) const { return nodes[n].left < 0; }
+
+    /*
+     * legacy prefix, REX if a register is xmm8 or above, and the opcode.
+     */
+    void opcode(uint8_t prefix, uint8_t op, int reg, int rm)
+    {
+        out.push_back(prefix);
+        uint8_t rex = 0x40 | (reg >= 8 ? 4 : 0) | (rm >= 8 ? 1 : 0);
+        if (rex != 0x40)
+            out.push_back(rex);
+        out.push_back(0x0F);
+        out.push_back(op);
+    }
+
+    void regReg(uint8_t prefix, uint8_t op, int dst, int src)
+    {
+        opcode(prefix, op, dst, src);
+        out.push_back((uint8_t) (0xC0 | (dst & 7) << 3 | (src & 7)));
+    }
+
+    /*
+     * op between xmm reg and the leaf n in memory: vars[slot] off rdi, or
+     * the constant, RIP-relative.
+     */
+    void regLeaf(uint8_t op, int reg, int n)
+    {
+        if (nodes[n].op == OP_CONST) {
+            poolLoad(op, reg, nodes[n].arg);
+            return;
+        }
+        opcode(0xF2, op, reg, 0);
+        int32_t disp = (int32_t) (8 * nodes[n].arg);
+        if (disp < 128) {
+            out.push_back((uint8_t) (0x40 | (reg & 7) << 3 | 7)); // [rdi + disp8]
+            out.push_back((uint8_t) disp);
+        } else {
+            out.push_back((uint8_t) (0x80 | (reg & 7) << 3 | 7)); // [rdi + disp32]
+            append(disp);
+        }
+    }
+
+    /*
+     * op between xmm reg and the value on top of the stack, [rsp].
+     */
+    void regTop(uint8_t op, int reg)
+    {
+        opcode(0xF2, op, reg, 0);
+        out.push_back((uint8_t) ((reg & 7) << 3 | 4));
+        out.push_back(0x24);
+    }
+
+    /*
+     * truncate the quotient in xmm reg toward zero as truncQuotient does:
+     * through rax. cvttsd2si gives the "integer indefinite"
+     * 0x8000000000000000 for NaN, infinities and values beyond 64 bits,
+     * which load the NaN that follows the constants instead (as does
+     * -2^63, which truncQuotient does not take either).
+     */
+    void truncate(int reg)
+    {
+        out.insert(out.end(), {0xF2, (uint8_t) (0x48 | (reg >= 8 ? 1 : 0)), 0x0F, 0x2C,
+                               (uint8_t) (0xC0 | (reg & 7))});             // cvttsd2si rax, xmm reg
+        out.insert(out.end(), {0x48, 0xB9, 0, 0, 0, 0, 0, 0, 0, 0x80});    // mov rcx, 0x8000000000000000
+        out.insert(out.end(), {0x48, 0x39, 0xC8});                         // cmp rax, rcx
+        out.insert(out.end(), {0xF2, (uint8_t) (0x48 | (reg >= 8 ? 4 : 0)), 0x0F, 0x2A,
+                               (uint8_t) (0xC0 | (reg & 7) << 3)});        // cvtsi2sd xmm reg, rax
+        out.insert(out.end(), {0x75, (uint8_t) (reg >= 8 ? 9 : 8)});       // jne over the load
+        poolLoad(MOVSD_LOAD, reg, (uint32_t) consts->size() + 1);          // movsd xmm reg, NaN
+    }
+
+    /*
+     * op xmm reg, [rip + disp32] addressing pool entry index.
+     */
+    void poolLoad(uint8_t op, int reg, uint32_t index)
+    {
+        opcode(0xF2, op, reg, 0);
+        out.push_back((uint8_t) ((reg & 7) << 3 | 5));
+        fixups.push_back(Fixup{out.size(), index});
+        append(0);
+    }
+
+    void append(int32_t v)
+    {
+        uint8_t b[4];
+        memcpy(b, &v, 4);
+        out.insert(out.end(), b, b + 4);
+    }
+
+    /*
+     * code that leaves the value of the subtree n in xmm r, using only
+     * xmm r and up.
+     */
+    void gen(int n, int r)
+    {
+        const Node & t = nodes[n];
+        if (isLeaf(n)) {
+            regLeaf(MOVSD_LOAD, r, n);
+            return;
+        }
+        genOp(t, r);
+        if (t.op == OP_IDIV) {
+            truncate(r);
+        } else if (t.op == OP_IMUL) {
+            poolLoad(ADDSD, r, (uint32_t) consts->size()); // add +0.0: -0 becomes +0
+        }
+    }
+
+    /*
+     * code that applies the operator of t to its two subtrees, leaving the
+     * result in xmm r; integer division and multiplication are not
+     * finished yet.
+     */
+    void genOp(const Node & t, int r)
+    {
+        uint8_t op = arith(t.op);
+        if (isLeaf(t.right)) {
+            gen(t.left, r);
+            regLeaf(op, r, t.right);
+            return;
+        }
+        int ll = nodes[t.left].label;
+        int lr = nodes[t.right].label;
+        int avail = REGS - r;
+        if (ll >= lr && lr < avail) {
+            // the left side first; the right one fits in the registers above it
+            gen(t.left, r);
+            gen(t.right, r + 1);
+            regReg(0xF2, op, r, r + 1);
+        } else if (lr > ll && ll < avail) {
+            // the right side first, then the left one above it
+            gen(t.right, r);
+            gen(t.left, r + 1);
+            if (t.op == OP_ADD || t.op == OP_MUL || t.op == OP_IMUL) {
+                regReg(0xF2, op, r, r + 1);
+            } else {
+                regReg(0xF2, op, r + 1, r);
+                regReg(0x66, 0x28, r, r + 1); // movapd
+            }
+        } else {
+            // both sides need more registers than are left: keep the right one on the stack
+            gen(t.right, r);
+            out.insert(out.end(), {0x48, 0x83, 0xEC, 0x08}); // sub rsp, 8
+            regTop(MOVSD_STORE, r);
+            gen(t.left, r);
+            regTop(op, r);
+            out.insert(out.end(), {0x48, 0x83, 0xC4, 0x08}); // add rsp, 8
+        }
+    }
+
+    std::vector<Node> nodes;
+    int root = -1;
+    const std::vector<double> * consts = nullptr;
+    std::vector<uint8_t> out;
+    std::vector<Fixup> fixups;
+};
+
+} // namespace
+
+#endif
+
+/*
+ * compile prog to native code where possible; otherwise keep a copy of
+ * it for run() to interpret.
+ */
+bool JitProgram::compile(const Program & prog)
+{
+    release();
+    fallback.clear();
+    if (prog.empty())
+        return false;
+
+#if JIT_X86_64
+    Emitter emitter;
+    if (emitter.build(prog)) {
+        std::vector<uint8_t> & bytes = emitter.emit();
+        void * p = mmap(nullptr, bytes.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            memcpy(p, bytes.data(), bytes.size());
+            if (mprotect(p, bytes.size(), PROT_READ | PROT_EXEC) == 0) {
+                code = p;
+                length = bytes.size();
+                return true;
+            }
+            munmap(p, bytes.size());
+        }
+    }
+#endif
+    fallback = prog;
+    return false;
+}
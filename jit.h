@@ -0,0 +1,76 @@
+#ifndef PROJ04SRC_JIT_H
+#define PROJ04SRC_JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "bytecode.h"
+
+/*
+ * An expression compiled to native code. On Linux x86-64 compile() turns
+ * the bytecode of BET::compile back into its tree and emits scalar SSE2
+ * code for it into memory mapped executable (and no longer writable once
+ * the code is in). Registers are allocated by Sethi-Ullman numbering: at
+ * every operator the subtree that needs more registers is evaluated
+ * first, so the tree is evaluated in the fewest of the 16 xmm registers,
+ * and only a subtree that needs more than are left is spilled to the
+ * stack. Variables and constants that are right operands are read from
+ * memory by the arithmetic instruction itself; constants sit next to the
+ * code. An integer division (OP_IDIV) is truncated through rax, or is NaN
+ * if it has no integer result, and an integer product (OP_IMUL) has +0.0
+ * added.
+ *
+ * The code is a plain function, entry(), called with the variable slots
+ * in vars and returning the value in xmm0. It computes exactly what
+ * VM::run computes. Where it cannot be used, on another architecture or
+ * for a tree deeper than MAX_DEPTH, entry() is null and run() interprets
+ * the bytecode with a VM instead.
+ */
+class JitProgram {
+public:
+    typedef double (*Fn)(const double * vars);
+
+    static const size_t MAX_DEPTH = 10000; // deepest nesting of operators compiled to native code
+
+    JitProgram() : code{nullptr}, length{0} { }
+    ~JitProgram() { release(); }
+
+    JitProgram(const JitProgram &) = delete;
+    JitProgram & operator= (const JitProgram &) = delete;
+
+    JitProgram(JitProgram && j) noexcept : code{j.code}, length{j.length}, fallback{std::move(j.fallback)}
+    {
+        j.code = nullptr;
+        j.length = 0;
+    }
+
+    JitProgram & operator= (JitProgram && j) noexcept
+    {
+        std::swap(code, j.code);
+        std::swap(length, j.length);
+        std::swap(fallback, j.fallback);
+        return *this;
+    }
+
+    static bool native(); //true if this build can emit native code at all
+
+    bool compile(const Program & prog); //compile prog. Return true if it became native code, false if run() interprets it.
+    Fn entry() const { return (Fn) code; } //the native function, or nullptr
+    double run(const double * vars) //evaluate with variable slot i bound to vars[i]
+    {
+        return code != nullptr ? entry()(vars) : vm.run(fallback, vars);
+    }
+
+    size_t codeSize() const { return length; } //bytes of native code and constants
+
+private:
+    void release(); //unmap the code
+
+    void * code;       // executable mapping, nullptr if not compiled to native code
+    size_t length;     // bytes mapped
+    Program fallback;  // what run() interprets when there is no native code
+    VM vm;
+};
+
+#endif //PROJ04SRC_JIT_H
@@ -0,0 +1,319 @@
+#include <array>
+#include <cstdint>
+
+#include "lexer.h"
+#include "char_scan.h"
+
+using namespace std;
+
+/*
+ * a lexer without input: next() returns SYM_NULL.
+ */
+Lexer::Lexer()
+        : in{nullptr}, ownsFile{false}, atEnd{true}, infix{false},
+          cur{nullptr}, lim{nullptr}, tokBegin{nullptr}, tokEnd{nullptr},
+          lineBegin{nullptr}, newLine{false}, base{nullptr}, consumed{0}
+{
+}
+
+/*
+ * tokenize [begin, end); the memory must outlive the lexer.
+ */
+Lexer::Lexer(const char * begin, const char * end)
+        : Lexer()
+{
+    setInput(begin, end);
+}
+
+/*
+ * tokenize the stream in, which the lexer reads but does not close.
+ */
+Lexer::Lexer(FILE * in)
+        : Lexer()
+{
+    setInput(in);
+}
+
+Lexer::~Lexer()
+{
+    close();
+}
+
+/*
+ * tokenize the file at path. Return false (leaving the lexer without
+ * input) if it cannot be opened.
+ */
+bool Lexer::open(const char * path)
+{
+    FILE * f = fopen(path, "r");
+    if (f == nullptr) {
+        setInput(nullptr, nullptr);
+        return false;
+    }
+    setInput(f);
+    ownsFile = true;
+    return true;
+}
+
+/*
+ * tokenize the file at path in place, mapped into memory. Return false
+ * (leaving the lexer without input) if it cannot be mapped, for instance
+ * because it is a pipe; open() can still read it then.
+ */
+bool Lexer::map(const char * path)
+{
+    close();
+    bool ok = mapped.open(path);
+    setMemory(mapped.begin(), mapped.end());
+    return ok;
+}
+
+/*
+ * tokenize the stream in from its current position.
+ */
+void Lexer::setInput(FILE * f)
+{
+    close();
+    in = f;
+    atEnd = (f == nullptr);
+    buf.clear();
+    cur = lim = tokBegin = tokEnd = lineBegin = base = buf.data();
+    newLine = false;
+    consumed = 0;
+}
+
+/*
+ * tokenize [begin, end).
+ */
+void Lexer::setInput(const char * begin, const char * end)
+{
+    close();
+    setMemory(begin, end);
+}
+
+/*
+ * scan [begin, end), keeping the file behind it open.
+ */
+void Lexer::setMemory(const char * begin, const char * end)
+{
+    atEnd = true;
+    cur = tokBegin = tokEnd = lineBegin = base = begin;
+    lim = end;
+    newLine = false;
+    consumed = 0;
+}
+
+/*
+ * class of the next token, SYM_NULL at the end of the input. The text of
+ * the token is lexeme().
+ */
+int Lexer::next()
+{
+    if (newLine) {
+        lineBegin = cur;
+        newLine = false;
+    }
+    int cls;
+    while ((cls = scan(cur)) == MORE) {
+        fill();
+    }
+    newLine = (cls == SYM_ENDLN);
+    return cls;
+}
+
+/*
+ * drop the input, closing or unmapping the file if the lexer opened it.
+ */
+void Lexer::close()
+{
+    if (ownsFile && in != nullptr) {
+        fclose(in);
+    }
+    in = nullptr;
+    ownsFile = false;
+    mapped.close();
+}
+
+/*
+ * append the next line of the stream (at most CHUNK bytes of it) to the
+ * buffer, first dropping the text before the current line, which has been
+ * consumed.
+ * Return false, and mark the end of the input, once the stream is dry.
+ */
+bool Lexer::fill()
+{
+    if (in == nullptr || atEnd) {
+        atEnd = true;
+        return false;
+    }
+    size_t drop = lineBegin - buf.data();
+    size_t pos = cur - lineBegin;
+    consumed += drop;
+    buf.erase(0, drop);
+    size_t old = buf.size();
+    buf.resize(old + CHUNK);
+    size_t n = 0;
+    int ch = 0;
+    while (n < CHUNK && (ch = getc(in)) != EOF) {
+        buf[old + n++] = (char) ch;
+        if (ch == '\n') {
+            break;
+        }
+    }
+    buf.resize(old + n);
+    if (ch == EOF) {
+        atEnd = true;
+    }
+    lineBegin = base = buf.data();
+    cur = tokBegin = tokEnd = base + pos;
+    lim = base + buf.size();
+    return n > 0;
+}
+
+// what a character starts, as found in CHAR_CLASS: the SYM_* code of a
+// one-character token, or one of these for the longer ones
+enum : uint8_t {
+    C_BLANK = 0x10, // ' ' '\t'
+    C_DIGIT,        // a number
+    C_NAME,         // a name
+    C_LINE_END,     // '\n' '\r'
+};
+
+static constexpr array<uint8_t, 256> charClasses()
+{
+    array<uint8_t, 256> t{};
+    for (int c = 0; c < 256; c++)
+        t[c] = SYM_INVAL;
+    for (int c = '0'; c <= '9'; c++)
+        t[c] = C_DIGIT;
+    for (int c = 'a'; c <= 'z'; c++)
+        t[c] = C_NAME;
+    for (int c = 'A'; c <= 'Z'; c++)
+        t[c] = C_NAME;
+    t['_'] = C_NAME;
+    t[' '] = t['\t'] = C_BLANK;
+    t['\n'] = t['\r'] = C_LINE_END;
+    t['+'] = SYM_ADD;
+    t['-'] = SYM_SUB;
+    t['*'] = SYM_MUL;
+    t['/'] = SYM_DIV;
+    t['('] = SYM_LPAREN;
+    t[')'] = SYM_RPAREN;
+    return t;
+}
+
+static constexpr array<uint8_t, 256> CHAR_CLASS = charClasses();
+
+static inline uint8_t charClass(char c)
+{
+    return CHAR_CLASS[(unsigned char) c];
+}
+
+static inline bool isDigit(char c)
+{
+    return charClass(c) == C_DIGIT;
+}
+
+static inline bool isNameChar(char c)
+{
+    uint8_t k = charClass(c);
+    return k == C_NAME || k == C_DIGIT;
+}
+
+/*
+ * skip blanks and comments from p on, then recognize the token there:
+ * set tokBegin and tokEnd to its text, move p past it and return its
+ * class. Return MORE, with p at the start of the token, if the token could
+ * go on past lim and the stream may still supply the rest.
+ */
+int Lexer::scan(const char * & p)
+{
+    for (;;) {
+        p = skipBlanks(p, lim);
+        if (p == lim) {
+            tokBegin = tokEnd = p;
+            return atEnd ? SYM_NULL : MORE;
+        }
+        const char * q = p + 1;
+        int cls = charClass(*p);
+        switch (cls) {
+        case C_DIGIT:
+            while (q < lim && isDigit(*q))
+                q++;
+            cls = SYM_INTEG;
+            if (q < lim && *q == '.') {
+                q++;
+                while (q < lim && isDigit(*q))
+                    q++;
+                cls = SYM_FLOAT;
+            }
+            if (q == lim && !atEnd)
+                return MORE;
+            break;
+        case C_NAME:
+            while (q < lim && isNameChar(*q))
+                q++;
+            if (q == lim && !atEnd)
+                return MORE;
+            cls = SYM_NAME;
+            break;
+        case C_LINE_END:
+            q = skipLineEnds(q, lim);
+            if (q == lim && !atEnd)
+                return MORE;
+            cls = SYM_ENDLN;
+            break;
+        case SYM_DIV:
+            if (q == lim && !atEnd)
+                return MORE;
+            if (q < lim && *q == '/') {
+                // a comment runs through the line ends after it
+                const char * e = findLineEnd(q + 1, lim);
+                if (e == lim && !atEnd)
+                    return MORE;
+                if (e < lim) {
+                    e = skipLineEnds(e, lim);
+                    if (e == lim && !atEnd)
+                        return MORE;
+                    p = e;
+                    continue;
+                }
+                // no line end follows: not a comment, just a "/"
+            }
+            break;
+        case SYM_LPAREN:
+        case SYM_RPAREN:
+            if (!infix)
+                cls = SYM_INVAL;
+            break;
+        default:
+            // another operator, or SYM_INVAL
+            break;
+        }
+        tokBegin = p;
+        tokEnd = q;
+        p = q;
+        return cls;
+    }
+}
+
+/* The single-input interface of opnum.h, kept for existing callers.
+ * Every thread has a lexer of its own behind it. */
+
+static thread_local Lexer defaultLexer;
+static thread_local string defaultText; // NUL-terminated copy of the last lexeme
+
+void set_input(int argc, char ** argv)
+{
+    ++argv, --argc;  /* skip over program name */
+    if (argc == 0 || (!defaultLexer.map(argv[0]) && !defaultLexer.open(argv[0])))
+        defaultLexer.setInput(stdin);
+}
+
+char * get_opnum(int * val)
+{
+    /* at the end of the input the class is zero */
+    *val = defaultLexer.next();
+    defaultText.assign(defaultLexer.lexeme());
+    return &defaultText[0];
+}
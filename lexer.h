@@ -0,0 +1,90 @@
+#ifndef PROJ04SRC_LEXER_H
+#define PROJ04SRC_LEXER_H
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include "opnum.h"
+#include "mapped_file.h"
+
+/*
+ * Tokenizer for postfix and infix expressions. Every Lexer is an independent object
+ * with its own input and position, so any number of them can run at once,
+ * one per thread or several per thread.
+ *
+ * It recognizes the grammar opnum.fl used to, with the same SYM_* codes:
+ *     [0-9]+                  SYM_INTEG
+ *     [0-9]+"."[0-9]*         SYM_FLOAT
+ *     [A-Za-z_][A-Za-z_0-9]*  SYM_NAME
+ *     + - * /                 SYM_ADD SYM_SUB SYM_MUL SYM_DIV
+ *     ( )                     SYM_LPAREN SYM_RPAREN in infix mode, else SYM_INVAL
+ *     [\r\n]+                 SYM_ENDLN
+ *     "//"[^\r\n]*[\r\n]+     skipped, line ends included
+ *     [ \t]                   skipped
+ *     any other character     SYM_INVAL
+ * and, like flex, always takes the longest match: a "//" that no line end
+ * follows is two SYM_DIV tokens. Parentheses only mean something in
+ * infix, so a lexer returns their codes only once setInfix(true) is called;
+ * to a postfix reader they are invalid characters like any other.
+ *
+ * Input is a block of memory the caller keeps alive, a file mapped into
+ * memory by map(), or a FILE* read a line at a time, so an interactive
+ * stdin gets its tokens as soon as each line is typed. Memory and mapped
+ * input is scanned in place: lexeme() points into it and offset() gives
+ * where the token starts, so no token is ever copied. The text of the
+ * current line is kept as well, so a caller can go back over its tokens
+ * without having stored them.
+ *
+ * Characters are classified through a 256-entry table, and runs of
+ * blanks, comment text and line ends are skipped 16 bytes at a time
+ * (char_scan.h).
+ */
+class Lexer {
+public:
+    Lexer(); //a lexer without input: next() returns SYM_NULL
+    Lexer(const char * begin, const char * end); //tokenize [begin, end), which must outlive the lexer
+    explicit Lexer(FILE * in); //tokenize the stream in, which the lexer does not close
+    ~Lexer();
+
+    Lexer(const Lexer &) = delete;
+    Lexer & operator= (const Lexer &) = delete;
+
+    bool open(const char * path); //tokenize the file at path, read as a stream. Return false if it cannot be opened.
+    bool map(const char * path); //tokenize the file at path in place, mapped into memory. Return false if it cannot be mapped.
+    void setInput(FILE * in); //tokenize the stream in from its current position
+    void setInput(const char * begin, const char * end); //tokenize [begin, end)
+    void setInfix(bool on) { infix = on; } //return SYM_LPAREN and SYM_RPAREN for "(" and ")" rather than SYM_INVAL
+
+    int next(); //class of the next token, SYM_NULL at the end of the input
+    std::string_view lexeme() const { return std::string_view(tokBegin, tokEnd - tokBegin); } //text of the last token, valid until the next call to next()
+    size_t offset() const { return consumed + (tokBegin - base); } //position of the last token from the start of the input
+    std::string_view line() const { return std::string_view(lineBegin, tokBegin - lineBegin); } //text of the current line up to the last token, valid until the next call to next()
+
+private:
+    static const size_t CHUNK = 65536; // most bytes read from a stream at a time
+    static const int MORE = -1;        // scan() result: the token may continue past the buffered input
+
+    void close(); //drop the input, closing or unmapping the file if the lexer opened it
+    void setMemory(const char * begin, const char * end); //scan [begin, end) without dropping the input first
+    bool fill(); //append the next line of the stream to the buffer. Return false at end of input.
+    int scan(const char * & p); //recognize the token at p and move p past it
+
+    std::string buf;        // text read from the stream, from the start of the current token on
+    MappedFile mapped;      // the file map() mapped
+    FILE * in;              // stream being read, nullptr for memory input
+    bool ownsFile;          // true if open() opened in
+    bool atEnd;             // true once no more input can arrive
+    bool infix;             // true if parentheses are tokens
+    const char * cur;       // next character to scan
+    const char * lim;       // end of the input available now
+    const char * tokBegin;  // text of the last token
+    const char * tokEnd;
+    const char * lineBegin; // start of the line the last token is on
+    bool newLine;           // true if the last token was SYM_ENDLN: the next one starts a line
+    const char * base;      // start of the memory input, or of buf
+    size_t consumed;        // bytes of the stream dropped from the front of buf
+};
+
+#endif //PROJ04SRC_LEXER_H
@@ -0,0 +1,130 @@
+#ifndef PROJ04SRC_LEXICON_H
+#define PROJ04SRC_LEXICON_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+/*
+ * A table of lexemes, owned by whatever keeps the tokens that point into
+ * it: a tree stores the long names of its nodes in one, and so does a
+ * program that keeps lines of tokens after the lexer has moved on. Every
+ * distinct lexeme is stored once, named by a 32-bit id, and stays where it
+ * is until clear(), which forgets them all but keeps the memory, so
+ * filling the table again with as much text does not allocate.
+ *
+ * Numbers never come here (a Token keeps their value), nor do lexemes
+ * short enough to be held in the Token itself, so a table only grows with
+ * the long names its owner holds. There is no lock: every owner, and so
+ * every thread, has its own.
+ */
+class Lexicon {
+public:
+    Lexicon() : current{0}, used{0} { }
+
+    Lexicon(const Lexicon &) = delete; // tokens point into the text
+    Lexicon & operator= (const Lexicon &) = delete;
+
+    // moving keeps the text where it is
+    Lexicon(Lexicon &&) = default;
+    Lexicon & operator= (Lexicon &&) = default;
+
+    /*
+     * return the id of s, storing a copy of it if it is new.
+     */
+    uint32_t intern(std::string_view s)
+    {
+        size_t hash = std::hash<std::string_view>()(s);
+        if (2 * (entries.size() + 1) > index.size())
+            grow();
+        size_t mask = index.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            uint32_t e = index[i];
+            if (e == 0) {
+                uint32_t id = (uint32_t) entries.size();
+                entries.push_back(Entry{store(s), hash});
+                index[i] = id + 1;
+                return id;
+            }
+            if (entries[e - 1].hash == hash && entries[e - 1].text == s)
+                return e - 1;
+        }
+    }
+
+    std::string_view view(uint32_t id) const { return entries[id].text; } //the lexeme with the given id, stored until clear()
+
+    size_t size() const { return entries.size(); } //number of distinct lexemes
+
+    /*
+     * forget every lexeme, keeping the memory for the next ones.
+     */
+    void clear()
+    {
+        entries.clear();
+        std::fill(index.begin(), index.end(), 0);
+        current = 0;
+        used = 0;
+    }
+
+private:
+    static const size_t BLOCK = 4096; // bytes of lexeme text allocated at a time
+
+    struct Entry {
+        std::string_view text; // points into blocks
+        size_t hash;
+    };
+
+    struct Block {
+        std::unique_ptr<char[]> text;
+        size_t size;
+    };
+
+    /*
+     * copy s into the text blocks and return the copy. Blocks kept from
+     * before the last clear() are filled again before a new one is made.
+     */
+    std::string_view store(std::string_view s)
+    {
+        while (current < blocks.size() && blocks[current].size - used < s.size()) {
+            current++;
+            used = 0;
+        }
+        if (current == blocks.size()) {
+            size_t n = s.size() > BLOCK ? s.size() : BLOCK;
+            blocks.push_back(Block{std::unique_ptr<char[]>(new char[n]), n});
+            used = 0;
+        }
+        char * copy = blocks[current].text.get() + used;
+        if (!s.empty())
+            memcpy(copy, s.data(), s.size());
+        used += s.size();
+        return std::string_view(copy, s.size());
+    }
+
+    /*
+     * double the index (to 16 slots at first) and enter every lexeme again.
+     */
+    void grow()
+    {
+        index.assign(index.empty() ? 16 : 2 * index.size(), 0);
+        size_t mask = index.size() - 1;
+        for (uint32_t id = 0; id < entries.size(); id++) {
+            size_t i = entries[id].hash & mask;
+            while (index[i] != 0)
+                i = (i + 1) & mask;
+            index[i] = id + 1;
+        }
+    }
+
+    std::vector<Entry> entries;  // id -> lexeme
+    std::vector<uint32_t> index; // open addressing on the hash: id + 1, or 0 for a free slot; a power of two in size
+    std::vector<Block> blocks;   // all text, in blocks that never move
+    size_t current;              // block being filled
+    size_t used;                 // bytes of it in use
+};
+
+#endif //PROJ04SRC_LEXICON_H
@@ -5,12 +5,12 @@
 
 using namespace std;
 
-void line_parse(std::list<Token> & postfix, int * ret)
+void line_parse(std::list<Token> & postfix, Lexicon & names, int * ret)
 {
     char * opnum = get_opnum(ret);
     if (*ret) {
         string str = opnum;
-        Token nt (str, *ret);
+        Token nt (str, *ret, names); // str goes away with this call
         cout << nt << endl;
         postfix.push_back(nt);
     }
@@ -21,11 +21,12 @@ int main(int argc, char ** argv)
     int retval;
 
     std::list<Token> opnumList;
+    Lexicon names; // long lexemes of the tokens in opnumList
 
     set_input(argc, argv);
 
     do {
-        line_parse(opnumList, &retval);
+        line_parse(opnumList, names, &retval);
     } while (retval > SYM_NULL);
 
     cout << "Postfix list: " << endl << opnumList <<endl;
@@ -0,0 +1,85 @@
+#ifndef PROJ04SRC_MAPPED_FILE_H
+#define PROJ04SRC_MAPPED_FILE_H
+
+#include <cstddef>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * A regular file mapped read-only into memory. The text is used in place:
+ * nothing is copied out of the page cache, and pages are only read when
+ * they are first touched. Empty files map to an empty range.
+ */
+class MappedFile {
+public:
+    MappedFile() : base{nullptr}, length{0} { }
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator= (const MappedFile &) = delete;
+
+    MappedFile(MappedFile && m) noexcept : base{m.base}, length{m.length}
+    {
+        m.base = nullptr;
+        m.length = 0;
+    }
+
+    MappedFile & operator= (MappedFile && m) noexcept
+    {
+        std::swap(base, m.base);
+        std::swap(length, m.length);
+        return *this;
+    }
+
+    /*
+     * map the file at path, dropping any earlier mapping. Return false if
+     * it cannot be opened or is not a regular file (a pipe or a terminal
+     * must be read instead).
+     */
+    bool open(const char * path)
+    {
+        close();
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+        if (ok && st.st_size > 0) {
+            void * p = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ok = false;
+            } else {
+                base = (const char *) p;
+                length = (size_t) st.st_size;
+                madvise(p, length, MADV_SEQUENTIAL); // read ahead: the text is scanned front to back
+            }
+        }
+        ::close(fd);
+        return ok;
+    }
+
+    /*
+     * unmap the file.
+     */
+    void close()
+    {
+        if (base != nullptr)
+            munmap((void *) base, length);
+        base = nullptr;
+        length = 0;
+    }
+
+    const char * begin() const { return base; }
+    const char * end() const { return base + length; }
+    size_t size() const { return length; }
+
+private:
+    const char * base;  // first byte of the mapping, nullptr if nothing is mapped
+    size_t length;      // bytes mapped
+};
+
+#endif //PROJ04SRC_MAPPED_FILE_H
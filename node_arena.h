@@ -0,0 +1,174 @@
+#ifndef PROJ04SRC_NODE_ARENA_H
+#define PROJ04SRC_NODE_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+/*
+ * Counters describing what a NodeArena currently holds.
+ *   slabs         -- slabs handed out since the last reset
+ *   reservedSlabs -- slabs owned by the arena (kept across resets)
+ *   liveNodes     -- nodes constructed and not yet destroyed
+ *   liveBytes     -- bytes occupied by those nodes
+ *   reservedBytes -- bytes owned by the arena in total
+ */
+struct ArenaStats {
+    size_t slabs;
+    size_t reservedSlabs;
+    size_t liveNodes;
+    size_t liveBytes;
+    size_t reservedBytes;
+};
+
+/*
+ * Bump-pointer pool for fixed size tree nodes.
+ *
+ * Nodes are carved out of large slabs one after another. A node released
+ * with destroy() goes onto a free list and is handed out again by the next
+ * create(). reset() rewinds the bump pointer to the first slab in O(1)
+ * without returning any memory, so a tree that is rebuilt over and over
+ * reuses the same slabs. reset() does NOT run destructors; the owner must
+ * do that first if Node is not trivially destructible.
+ */
+template <typename Node>
+class NodeArena {
+public:
+    explicit NodeArena(size_t nodesPerSlab = 256)
+            : perSlab{nodesPerSlab ? nodesPerSlab : 1}, curSlab{0}, used{0}, freeList{nullptr}, live{0}
+    { }
+
+    ~NodeArena()
+    {
+        for (char *s : slabs)
+            ::operator delete(s);
+    }
+
+    NodeArena(const NodeArena &) = delete;
+    NodeArena & operator= (const NodeArena &) = delete;
+
+    /*
+     * take over the slabs of a; a is left without any.
+     */
+    NodeArena(NodeArena && a) noexcept
+            : perSlab{a.perSlab}, curSlab{0}, used{0}, freeList{nullptr}, live{0}
+    {
+        swap(a);
+    }
+
+    /*
+     * exchange slabs with a. The slabs this arena had go to a and are
+     * freed or reused from there; the owner must destroy its nodes first.
+     */
+    NodeArena & operator= (NodeArena && a) noexcept
+    {
+        swap(a);
+        return *this;
+    }
+
+    /*
+     * exchange everything with a in O(1). Nodes keep their addresses.
+     */
+    void swap(NodeArena & a) noexcept
+    {
+        slabs.swap(a.slabs);
+        std::swap(perSlab, a.perSlab);
+        std::swap(curSlab, a.curSlab);
+        std::swap(used, a.used);
+        std::swap(freeList, a.freeList);
+        std::swap(live, a.live);
+    }
+
+    /*
+     * allocate room for one node (free list first, then the bump pointer)
+     * and construct it in place from args.
+     */
+    template <typename... Args>
+    Node * create(Args &&... args)
+    {
+        void *mem;
+        if (freeList != nullptr) {
+            mem = freeList;
+            freeList = freeList->next;
+        } else {
+            mem = bump();
+        }
+        Node *n = new (mem) Node(std::forward<Args>(args)...);
+        live++;
+        return n;
+    }
+
+    /*
+     * run the destructor of n and put its cell on the free list.
+     */
+    void destroy(Node *n)
+    {
+        if (n == nullptr)
+            return;
+        n->~Node();
+        FreeCell *cell = reinterpret_cast<FreeCell *>(n);
+        cell->next = freeList;
+        freeList = cell;
+        live--;
+    }
+
+    /*
+     * forget every node in O(1). The slabs stay allocated and are reused
+     * by the following create() calls.
+     */
+    void reset()
+    {
+        curSlab = 0;
+        used = 0;
+        freeList = nullptr;
+        live = 0;
+    }
+
+    ArenaStats stats() const
+    {
+        ArenaStats s;
+        s.slabs = (slabs.empty() || (curSlab == 0 && used == 0)) ? 0 : curSlab + 1;
+        s.reservedSlabs = slabs.size();
+        s.liveNodes = live;
+        s.liveBytes = live * sizeof(Node);
+        s.reservedBytes = slabs.size() * perSlab * cellSize();
+        return s;
+    }
+
+private:
+    struct FreeCell {
+        FreeCell *next;
+    };
+
+    static constexpr size_t cellSize()
+    {
+        // every cell must be able to hold a node, a free list link, and keep the next cell aligned
+        return ((sizeof(Node) > sizeof(FreeCell) ? sizeof(Node) : sizeof(FreeCell)) + alignof(Node) - 1)
+               / alignof(Node) * alignof(Node);
+    }
+
+    void * bump()
+    {
+        if (!slabs.empty() && used == perSlab && curSlab + 1 < slabs.size()) {
+            // move on to a slab kept from before the last reset
+            curSlab++;
+            used = 0;
+        }
+        if (slabs.empty() || used == perSlab) {
+            slabs.push_back(static_cast<char *>(::operator new(perSlab * cellSize())));
+            curSlab = slabs.size() - 1;
+            used = 0;
+        }
+        return slabs[curSlab] + (used++) * cellSize();
+    }
+
+    std::vector<char *> slabs; // all slabs owned by the arena
+    size_t perSlab;            // number of node cells per slab
+    size_t curSlab;            // slab the bump pointer is in
+    size_t used;               // cells handed out from slabs[curSlab]
+    FreeCell *freeList;        // destroyed cells waiting to be reused
+    size_t live;               // nodes currently constructed
+};
+
+#endif //PROJ04SRC_NODE_ARENA_H
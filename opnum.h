@@ -18,6 +18,12 @@
 #define SYM_ENDLN  0x8
 #define SYM_INVAL  0x9
 
+/* parentheses are not part of a postfix expression: a lexer returns
+   these only in infix mode, and SYM_INVAL for them otherwise */
+#define SYM_LPAREN 0xA
+#define SYM_RPAREN 0xB
+
+/* single-input interface over a per-thread Lexer (lexer.h) */
 extern void set_input(int argc, char ** argv);
 extern char * get_opnum(int *val);
 #endif
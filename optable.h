@@ -0,0 +1,72 @@
+#ifndef PROJ04SRC_OPTABLE_H
+#define PROJ04SRC_OPTABLE_H
+
+#include <cstdint>
+
+#include "opnum.h"
+
+/*
+ * Precedence and associativity of every token class, indexed by the
+ * class code from opnum.h. Operands bind tighter than any operator, so an
+ * operand never needs parentheses. Adding an operator means adding a code
+ * to opnum.h and a row here.
+ */
+enum Assoc : uint8_t {
+    ASSOC_NONE,
+    ASSOC_LEFT,
+    ASSOC_RIGHT
+};
+
+struct OpInfo {
+    char symbol;     // spelling of the operator, 0 for operands
+    uint8_t prec;    // higher binds tighter
+    Assoc assoc;     // how a chain of operators of equal precedence groups
+};
+
+#define PREC_OPERAND 0xff
+
+constexpr OpInfo OP_TABLE[] = {
+        /* SYM_NULL  */ {0, 0, ASSOC_NONE},
+        /* SYM_NAME  */ {0, PREC_OPERAND, ASSOC_NONE},
+        /* SYM_INTEG */ {0, PREC_OPERAND, ASSOC_NONE},
+        /* SYM_FLOAT */ {0, PREC_OPERAND, ASSOC_NONE},
+        /* SYM_ADD   */ {'+', 1, ASSOC_LEFT},
+        /* SYM_SUB   */ {'-', 1, ASSOC_LEFT},
+        /* SYM_MUL   */ {'*', 2, ASSOC_LEFT},
+        /* SYM_DIV   */ {'/', 2, ASSOC_LEFT},
+};
+
+constexpr int OP_TABLE_SIZE = sizeof(OP_TABLE) / sizeof(OP_TABLE[0]);
+
+static_assert(OP_TABLE_SIZE == SYM_DIV + 1, "OP_TABLE needs one row per token class up to the last operator");
+
+/*
+ * precedence of the token class cls; classes without a row count as operands.
+ */
+constexpr int precedence(int cls)
+{
+    return cls >= 0 && cls < OP_TABLE_SIZE ? OP_TABLE[cls].prec : PREC_OPERAND;
+}
+
+/*
+ * associativity of the token class cls.
+ */
+constexpr Assoc associativity(int cls)
+{
+    return cls >= 0 && cls < OP_TABLE_SIZE ? OP_TABLE[cls].assoc : ASSOC_NONE;
+}
+
+/*
+ * true if a child of class child under an operator of class parent must be
+ * put in parentheses when printed in infix: always when it binds looser,
+ * and at equal precedence when it sits on the side the parent does not
+ * group towards (the right side of a left-associative operator).
+ */
+constexpr bool needsParens(int parent, int child, bool rightChild)
+{
+    return precedence(child) < precedence(parent) ||
+           (precedence(child) == precedence(parent) &&
+            associativity(parent) == (rightChild ? ASSOC_LEFT : ASSOC_RIGHT));
+}
+
+#endif //PROJ04SRC_OPTABLE_H
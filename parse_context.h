@@ -0,0 +1,36 @@
+#ifndef PROJ04SRC_PARSE_CONTEXT_H
+#define PROJ04SRC_PARSE_CONTEXT_H
+
+#include <iostream>
+
+/*
+ * Everything it takes to turn one line of tokens into a tree, kept from
+ * one line to the next: the tree, whose node storage (the arena of a BET,
+ * the columns of a FlatBET) is rewound instead of freed when the next
+ * expression is built into it, and the builder with its operand stack.
+ * Tokens go from the lexer straight into the builder, so there is no
+ * token storage to keep. Once the lines stop getting longer, building
+ * them does no heap allocation at all: numbers and short names live in
+ * the tokens, and the table of long names the tree keeps is cleared, not
+ * freed, with its nodes.
+ *
+ * Tree is BET<Token> or FlatBET. Builder reads postfix by default;
+ * InfixBuilder<Tree> reads infix.
+ */
+template <typename Tree, typename Builder = typename Tree::Builder>
+class ParseContext {
+public:
+    Builder & start(std::ostream & out = std::cout) //start building the next expression into tree(); errors go to out
+    {
+        builder.start(expr, out);
+        return builder;
+    }
+
+    Tree & tree() { return expr; } //the tree the builder fills
+
+private:
+    Tree expr;
+    Builder builder; // declared after expr: it may still give nodes back to expr when destroyed
+};
+
+#endif //PROJ04SRC_PARSE_CONTEXT_H
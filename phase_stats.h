@@ -0,0 +1,177 @@
+#ifndef PROJ04SRC_PHASE_STATS_H
+#define PROJ04SRC_PHASE_STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <streambuf>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Per-phase timers and counters for bet_driver's --stats.
+ *
+ * A PhaseClock charges the time between two calls of enter() to the phase
+ * entered by the first, so switching phases costs a single read of the
+ * time stamp counter (or of steady_clock where there is none), and a
+ * clock made without a PhaseStats reads nothing at all. The PHASE and
+ * PHASE_ADD macros are the only way the driver touches them: building
+ * with BET_STATS=0 turns them into nothing.
+ */
+
+#ifndef BET_STATS
+#define BET_STATS 1
+#endif
+
+enum Phase {
+    PHASE_LEX,      // Lexer::next
+    PHASE_BUILD,    // making Tokens and feeding them to the tree builder
+    PHASE_SIMPLIFY, // -s
+    PHASE_STATS,    // size, leaves, depth, breadth, profile, DAG and value
+    PHASE_COPY,     // the copy, assignment and move tests
+    PHASE_PRINT,    // formatting expressions and results
+    PHASE_WRITE,    // handing output to the standard output
+    PHASE_COUNT,
+    PHASE_NONE = PHASE_COUNT
+};
+
+enum Counter {
+    COUNT_LINES,       // lines with tokens
+    COUNT_TOKENS,      // correct tokens
+    COUNT_NODES,       // nodes in the trees built
+    COUNT_ALLOCATIONS, // heap allocations while processing lines
+    COUNT_BYTES,       // bytes written to the standard output
+    COUNTER_COUNT
+};
+
+static const char * const PHASE_NAMES[PHASE_COUNT] = {
+    "lex", "build", "simplify", "stats", "copy", "print", "write"
+};
+
+static const char * const COUNTER_NAMES[COUNTER_COUNT] = {
+    "lines", "tokens", "nodes", "allocations", "bytes_written"
+};
+
+/*
+ * a time stamp in ticks: TSC cycles on x86, nanoseconds elsewhere.
+ */
+inline uint64_t readTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/*
+ * Time and entries of every phase, and the counters, of one thread or of
+ * all of them added up.
+ */
+struct PhaseStats {
+    uint64_t ticks[PHASE_COUNT] = {};
+    uint64_t entries[PHASE_COUNT] = {};
+    uint64_t counts[COUNTER_COUNT] = {};
+
+    void add(const PhaseStats & s)
+    {
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            ticks[p] += s.ticks[p];
+            entries[p] += s.entries[p];
+        }
+        for (int c = 0; c < COUNTER_COUNT; c++)
+            counts[c] += s.counts[c];
+    }
+};
+
+/*
+ * Charges elapsed time to the phase last entered. With no PhaseStats it
+ * does nothing.
+ */
+class PhaseClock {
+public:
+    explicit PhaseClock(PhaseStats * stats) : stats{stats}, current{PHASE_NONE}, since{0} { }
+    ~PhaseClock() { enter(PHASE_NONE); }
+
+    PhaseClock(const PhaseClock &) = delete;
+    PhaseClock & operator= (const PhaseClock &) = delete;
+
+    /*
+     * charge the time since the last call to the current phase and make
+     * p the current phase (PHASE_NONE stops the clock).
+     */
+    void enter(Phase p)
+    {
+        if (stats == nullptr || p == current)
+            return;
+        uint64_t now = readTicks();
+        if (current != PHASE_NONE)
+            stats->ticks[current] += now - since;
+        if (p != PHASE_NONE)
+            stats->entries[p]++;
+        current = p;
+        since = now;
+    }
+
+private:
+    PhaseStats * stats;
+    Phase current;
+    uint64_t since;  // ticks when current was entered
+};
+
+/*
+ * Stream buffer that passes everything on to another one, counting the
+ * bytes and charging the time the other one takes to PHASE_WRITE of its
+ * own PhaseStats. That time is also part of whichever phase was writing.
+ */
+class CountingBuffer : public std::streambuf {
+public:
+    CountingBuffer(std::streambuf * sink, PhaseStats & stats) : sink{sink}, stats{stats}, clock{&stats} { }
+
+protected:
+    int overflow(int c) override
+    {
+        if (c == traits_type::eof())
+            return sync() == 0 ? traits_type::not_eof(c) : c;
+        clock.enter(PHASE_WRITE);
+        stats.counts[COUNT_BYTES]++;
+        int r = sink->sputc((char) c);
+        clock.enter(PHASE_NONE);
+        return r;
+    }
+
+    std::streamsize xsputn(const char * s, std::streamsize n) override
+    {
+        clock.enter(PHASE_WRITE);
+        stats.counts[COUNT_BYTES] += n;
+        std::streamsize r = sink->sputn(s, n);
+        clock.enter(PHASE_NONE);
+        return r;
+    }
+
+    int sync() override
+    {
+        clock.enter(PHASE_WRITE);
+        int r = sink->pubsync();
+        clock.enter(PHASE_NONE);
+        return r;
+    }
+
+private:
+    std::streambuf * sink;
+    PhaseStats & stats;
+    PhaseClock clock;
+};
+
+#if BET_STATS
+#define PHASE(clock, phase) (clock).enter(phase)
+#define PHASE_ADD(stats, counter, n) ((stats).counts[counter] += (n))
+#else
+#define PHASE(clock, phase) ((void) 0)
+#define PHASE_ADD(stats, counter, n) ((void) 0)
+#endif
+
+#endif //PROJ04SRC_PHASE_STATS_H
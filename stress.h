@@ -0,0 +1,60 @@
+#ifndef PROJ04SRC_STRESS_H
+#define PROJ04SRC_STRESS_H
+
+#include <chrono>
+#include <random>
+#include <streambuf>
+#include <string>
+
+#include "opnum.h"
+#include "lexer.h"
+#include "token.h"
+
+using namespace std;
+
+/*
+ * What the checks of bet_stress share. Each check prints a heading and
+ * one line per phase: report() for a phase that is timed and checked,
+ * timing() for one that is only timed and check() for a result that is
+ * not worth timing. A wrong result makes bet_stress exit 1.
+ */
+
+/* Swallows everything written to it. */
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char *, streamsize n) override { return n; }
+};
+
+void report(const char * phase, chrono::steady_clock::time_point start, long got, long want); //how long the phase since start took, and whether got == want
+void timing(const char * phase, chrono::steady_clock::time_point start); //how long the phase since start took
+void check(const char * phase, long got, long want); //whether got == want
+
+string randomPostfix(mt19937 & rng, int maxOperators, int names, bool floats = false); //a random expression over v0 .. v(names - 1) and one-digit numbers
+void balancedPostfix(mt19937 & rng, int levels, int names, string & postfix); //appends a complete tree of the given number of levels
+
+/* Lexes text, as infix if infix is set, feeds its tokens to builder and
+ * finishes the tree. */
+template <typename Builder>
+bool buildFrom(const string & text, Builder & builder, bool infix = false)
+{
+    Lexer lex(text.data(), text.data() + text.size());
+    lex.setInfix(infix);
+    int cls;
+    while ((cls = lex.next()) > SYM_NULL && cls != SYM_ENDLN) {
+        builder.push(Token(lex.lexeme(), cls));
+    }
+    return builder.finish();
+}
+
+// the checks, in stress_trees.cpp and stress_eval.cpp
+void chainCheck(long levels); //deep chains through every phase of a tree's life
+void reparseCheck();          //one line parsed over and over without allocating
+void roundTripCheck();        //random trees through their printed infix
+void simplifyCheck();         //simplified trees print postfix that reads back
+void evalCheck();             //compiled evaluators agree with BET::evaluate
+void dagCheck();              //an ExprDag agrees with BET::evaluate
+void jitCheck();              //native code agrees with the VM
+void imageCheck();            //trees read back from an expression image
+
+#endif //PROJ04SRC_STRESS_H
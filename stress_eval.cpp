@@ -0,0 +1,231 @@
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+
+#include "stress.h"
+#include "bet.h"
+#include "flat_bet.h"
+#include "environment.h"
+#include "bytecode.h"
+#include "batch_eval.h"
+#include "closure.h"
+#include "jit.h"
+#include "expr_dag.h"
+#include "expr_image.h"
+
+static const int EVAL_CHECKS = 100000;
+static const int DAG_CHECKS = 20000;
+static const int JIT_CHECKS = 20000;
+static const int JIT_BALANCED_LEVELS = 18; // 2^18 leaves need more than the 16 xmm registers
+static const int IMAGE_EXPRESSIONS = 20000;
+
+/* Evaluates EVAL_CHECKS random expressions of up to 8 operators with
+ * BET::evaluate, then compiles each and runs it on the VM, as a
+ * ClosureTree, on the BatchEvaluator and, where there is one, on the JIT.
+ * v0 .. v3 are integers and v4, v5 doubles, so integer division must
+ * truncate in every evaluator; 8 operators on one-digit numbers stay well
+ * within the 53 bits a double holds exactly. Once v0 is bound to a double,
+ * a program that reads it must no longer fit the environment. */
+void evalCheck()
+{
+    cout << "Evaluators, " << EVAL_CHECKS << " expressions:" << endl;
+    mt19937 rng(4);
+    long same = 0;
+    long typed = 0;
+    VM vm;
+    BatchEvaluator batch;
+    auto agree = [](double got, double want) {
+        return got == want || (got != got && want != want);
+    };
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < EVAL_CHECKS; i++) {
+        BET<Token> tree;
+        BET<Token>::Builder builder(tree);
+        buildFrom(randomPostfix(rng, 8, 6), builder);
+        Environment env;
+        for (int v = 0; v < 6; v++) {
+            int n = (int) (rng() % 19) - 9;
+            env.set("v" + to_string(v), v < 4 ? Value::ofInt(n) : Value::ofDouble(n + 0.5));
+        }
+        double want = tree.evaluate(env).asDouble();
+
+        Program prog;
+        tree.compile(prog, env);
+        vector<double> vars;
+        env.toDoubles(vars);
+        vector<const double *> columns;
+        for (double & v : vars) {
+            columns.push_back(&v);
+        }
+        ClosureTree closure;
+        closure.compile(prog);
+        double batched;
+        batch.run(prog, columns.data(), 1, &batched);
+        JitProgram jit;
+        bool native = jit.compile(prog);
+        same += agree(vm.run(prog, vars.data()), want) && agree(closure.run(vars.data()), want) &&
+                agree(batched, want) && (!native || agree(jit.entry()(vars.data()), want));
+
+        bool fitted = env.fits(prog);
+        env.set("v0", Value::ofDouble(0.5));
+        typed += fitted && env.fits(prog) != prog.reads(env.find("v0"));
+    }
+    report("same value as BET::evaluate", start, same, EVAL_CHECKS);
+    check("programs fit only the variable types they were compiled for", typed, EVAL_CHECKS);
+}
+
+/* Adds DAG_CHECKS random expressions over 3 integer variables to one
+ * ExprDag, where they share many subexpressions, and then evaluates each
+ * from its root: the value must be what BET::evaluate gives, although
+ * every other expression sits in the same DAG. */
+void dagCheck()
+{
+    cout << "DAG, " << DAG_CHECKS << " expressions:" << endl;
+    mt19937 rng(6);
+    ExprDag dag;
+    Environment env;
+    for (int v = 0; v < 3; v++) {
+        env.set("v" + to_string(v), Value::ofInt(v + 2));
+    }
+    vector<uint32_t> roots;
+    vector<Value> want;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < DAG_CHECKS; i++) {
+        BET<Token> tree;
+        BET<Token>::Builder builder(tree);
+        buildFrom(randomPostfix(rng, 12, 3), builder);
+        roots.push_back(tree.toDag(dag));
+        want.push_back(tree.evaluate(env));
+    }
+    long same = 0;
+    for (int i = 0; i < DAG_CHECKS; i++) {
+        Value got = dag.evaluate(roots[i], env);
+        same += got.isInt == want[i].isInt &&
+                (got.isInt ? got.i == want[i].i : got.d == want[i].d || (got.d != got.d && want[i].d != want[i].d));
+    }
+    report("same value as BET::evaluate", start, same, DAG_CHECKS);
+}
+
+/* Compiles JIT_CHECKS random expressions over 40 variables, and a
+ * balanced one of JIT_BALANCED_LEVELS levels, to native code and checks
+ * that each computes the same value as the VM. */
+void jitCheck()
+{
+    cout << "JIT, " << JIT_CHECKS + 1 << " expressions:" << endl;
+    if (!JitProgram::native()) {
+        cout << "  no native code on this architecture" << endl;
+        return;
+    }
+    mt19937 rng(2);
+    long same = 0;
+    VM vm;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i <= JIT_CHECKS; i++) {
+        string postfix;
+        if (i < JIT_CHECKS) {
+            postfix = randomPostfix(rng, 60, 40);
+        } else {
+            balancedPostfix(rng, JIT_BALANCED_LEVELS, 40, postfix);
+        }
+        BET<Token> tree;
+        BET<Token>::Builder builder(tree);
+        buildFrom(postfix, builder);
+        Environment env;
+        Program prog;
+        tree.compile(prog, env);
+        vector<double> vars(env.size());
+        for (size_t s = 0; s < vars.size(); s++) {
+            vars[s] = 1.5 + 0.25 * s;
+        }
+        JitProgram jit;
+        if (!jit.compile(prog)) {
+            continue;
+        }
+        double want = vm.run(prog, vars.data());
+        double got = jit.entry()(vars.data());
+        same += got == want || (got != got && want != want);
+    }
+    report("same value as the VM", start, same, JIT_CHECKS + 1);
+}
+
+/* Saves IMAGE_EXPRESSIONS random expressions, each from a BET and from a
+ * FlatBET, to an image in a temporary file and maps it back: every
+ * expression must print the same postfix, build the same trees again,
+ * and compile to bytecode that computes what the tree's bytecode does. */
+void imageCheck()
+{
+    mt19937 rng(3);
+    vector<string> postfixes;
+    ExprImageWriter writer;
+    ExprImage image;
+    string error;
+
+    cout << "Image, " << 2 * IMAGE_EXPRESSIONS << " expressions:" << endl;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < IMAGE_EXPRESSIONS; i++) {
+        postfixes.push_back(randomPostfix(rng, 30, 10) + "12345678901234567890 0.25 * +");
+        BET<Token> tree;
+        BET<Token>::Builder builder(tree);
+        FlatBET flat;
+        FlatBET::Builder flatBuilder(flat);
+        buildFrom(postfixes.back(), builder);
+        buildFrom(postfixes.back(), flatBuilder);
+        tree.save(writer);
+        flat.save(writer);
+    }
+    char path[] = "/tmp/bet_stressXXXXXX";
+    int fd = mkstemp(path);
+    bool saved = fd >= 0 && writer.save(path);
+    if (fd >= 0) {
+        close(fd);
+    }
+    report("save", start, saved, true);
+
+    start = chrono::steady_clock::now();
+    bool opened = saved && image.open(path, error);
+    unlink(path);
+    report("open", start, opened, true);
+    if (!opened) {
+        return;
+    }
+
+    start = chrono::steady_clock::now();
+    long same = 0;
+    VM vm;
+    vector<double> vars(16);
+    for (size_t s = 0; s < vars.size(); s++) {
+        vars[s] = 1.5 + 0.25 * s;
+    }
+    for (size_t e = 0; e < image.size(); e++) {
+        BET<Token> tree;
+        BET<Token>::Builder builder(tree);
+        buildFrom(postfixes[e / 2], builder);
+        BET<Token> back;
+        BET<Token>::Builder backBuilder(back);
+        image.build(e, backBuilder);
+        backBuilder.finish();
+        FlatBET flat;
+        FlatBET::Builder flatBuilder(flat);
+        image.build(e, flatBuilder);
+        flatBuilder.finish();
+
+        ostringstream want, fromImage, fromTree, fromFlat, infix, backInfix;
+        tree.printPostfixExpression(want);
+        image.printPostfix(e, fromImage);
+        back.printPostfixExpression(fromTree);
+        flat.printPostfixExpression(fromFlat);
+        tree.printInfixExpression(infix);
+        back.printInfixExpression(backInfix);
+
+        Environment env;
+        Program prog, imageProg;
+        tree.compile(prog, env);
+        image.compile(e, imageProg, env);
+        double value = vm.run(prog, vars.data());
+        double imageValue = vm.run(imageProg, vars.data());
+        same += want.str() == fromImage.str() && want.str() == fromTree.str() && want.str() == fromFlat.str() &&
+                infix.str() == backInfix.str() && (imageValue == value || (imageValue != imageValue && value != value));
+    }
+    report("same trees and values", start, same, 2 * IMAGE_EXPRESSIONS);
+}
@@ -0,0 +1,221 @@
+#include <list>
+#include <sstream>
+#include <utility>
+
+#include "stress.h"
+#include "bet.h"
+#include "flat_bet.h"
+#include "environment.h"
+#include "parse_context.h"
+#include "infix_builder.h"
+#include "alloc_count.h"
+
+static const long REPARSE_LINES = 1000000;
+static const int ROUND_TRIPS = 100000;
+static const int SIMPLIFY_CHECKS = 100000;
+
+/* Runs every phase on the chain of the given shape. */
+static void stress(const char * shape, bool leftChain, long levels)
+{
+    Token a("a"sv, SYM_NAME);
+    Token plus("+"sv, SYM_ADD);
+    list<Token> postfix;
+    if (leftChain) {
+        postfix.push_back(a);
+        for (long i = 0; i < levels; i++) {
+            postfix.push_back(a);
+            postfix.push_back(plus);
+        }
+    } else {
+        for (long i = 0; i <= levels; i++) {
+            postfix.push_back(a);
+        }
+        for (long i = 0; i < levels; i++) {
+            postfix.push_back(plus);
+        }
+    }
+    cout << shape << " chain, " << levels << " levels:" << endl;
+
+    auto start = chrono::steady_clock::now();
+    BET<Token> tree;
+    bool built = tree.buildFromPostfix(postfix);
+    report("build", start, built, true);
+    if (!built) {
+        return;
+    }
+
+    start = chrono::steady_clock::now();
+    report("size", start, (long) tree.size(), 2 * levels + 1); // the walk that also finds the other statistics
+    check("leaves", tree.leaves(), levels + 1);
+    check("depth", tree.depth(), levels);
+    check("breadth", tree.breadth(), levels > 0 ? 2 : 1);
+
+    NullBuffer discard;
+    streambuf * out = cout.rdbuf(&discard);
+    auto printStart = chrono::steady_clock::now();
+    tree.printInfixExpression();
+    auto postfixStart = chrono::steady_clock::now();
+    tree.printPostfixExpression();
+    cout.rdbuf(out);
+    timing("print infix", printStart);
+    timing("print postfix", postfixStart);
+
+    {
+        ostringstream infix, want, got;
+        tree.printInfixExpression(infix);
+        tree.printPostfixExpression(want);
+        start = chrono::steady_clock::now();
+        BET<Token> back;
+        InfixBuilder<BET<Token> > builder(back);
+        bool ok = buildFrom(infix.str(), builder, true);
+        back.printPostfixExpression(got);
+        report("build from printed infix", start, ok && got.str() == want.str(), true);
+    }
+
+    Environment env;
+    env.set("a", Value::ofInt(1));
+    start = chrono::steady_clock::now();
+    Value v = tree.evaluate(env);
+    report("evaluate", start, v.isInt ? (long) v.i : -1, levels + 1);
+
+    {
+        start = chrono::steady_clock::now();
+        BET<Token> copy(tree);
+        report("copy", start, (long) copy.size(), 2 * levels + 1);
+        start = chrono::steady_clock::now();
+    }
+    timing("destroy copy", start);
+
+    start = chrono::steady_clock::now();
+    BET<Token> moved(std::move(tree));
+    tree = std::move(moved);
+    report("move there and back", start, (long) tree.size(), 2 * levels + 1);
+
+    tree.setCopyOnWrite(true);
+    {
+        start = chrono::steady_clock::now();
+        BET<Token> shared(tree);
+        report("copy-on-write copy", start, shared.empty(), false);
+        start = chrono::steady_clock::now();
+        report("count shared nodes", start, (long) shared.shareStats().sharedNodes, 2 * levels + 1);
+    }
+
+    postfix.push_back(Token("0"sv, SYM_INTEG));
+    postfix.push_back(Token("*"sv, SYM_MUL));
+    tree.buildFromPostfix(postfix);
+    postfix.clear();
+    {
+        BET<Token> shared(tree);
+        start = chrono::steady_clock::now();
+        size_t eliminated = shared.simplify();
+        report("simplify x * 0 of a shared copy", start, (long) eliminated, 2 * levels + 2);
+        check("original untouched", (long) tree.size(), 2 * levels + 3);
+    }
+    start = chrono::steady_clock::now();
+    size_t eliminated = tree.simplify();
+    report("simplify x * 0", start, (long) eliminated, 2 * levels + 2);
+
+    start = chrono::steady_clock::now();
+    tree.makeEmpty();
+    report("makeEmpty", start, tree.empty(), true);
+}
+
+/* Lexes and builds the same line REPARSE_LINES times with one
+ * ParseContext. The first line sizes the tree's storage and the builder's
+ * stack; the heap allocations of all the others must add up to zero. */
+template <typename Tree>
+static void reparse(const char * kind)
+{
+    static const char line[] = "a b + c * 2.5 d / - x_1 12 * +\n";
+    ParseContext<Tree> ctx;
+    size_t allocations = 0;
+    bool built = true;
+
+    cout << kind << ", " << REPARSE_LINES << " lines:" << endl;
+    auto start = chrono::steady_clock::now();
+    for (long i = 0; i < REPARSE_LINES; i++) {
+        size_t before = heapAllocations();
+        Lexer lex(line, line + sizeof(line) - 1);
+        typename Tree::Builder & builder = ctx.start();
+        int cls;
+        while ((cls = lex.next()) > SYM_NULL && cls != SYM_ENDLN) {
+            builder.push(Token(lex.lexeme(), cls));
+        }
+        built = builder.finish() && built;
+        if (i > 0) {
+            allocations += heapAllocations() - before;
+        }
+    }
+    report("reparse", start, built, true);
+    check("heap allocations after the first line", (long) allocations, 0);
+}
+
+/* Builds ROUND_TRIPS random expressions of up to 20 operators from
+ * postfix, prints them in infix, builds them again from that and checks
+ * that the postfix printed from both trees is the same. */
+template <typename Tree>
+static void roundTrip(const char * kind)
+{
+    mt19937 rng(1);
+    long same = 0;
+
+    cout << kind << ", " << ROUND_TRIPS << " infix round trips:" << endl;
+    auto start = chrono::steady_clock::now();
+    Tree tree, back;
+    for (int i = 0; i < ROUND_TRIPS; i++) {
+        string postfix = randomPostfix(rng, 20, 5);
+        typename Tree::Builder builder(tree);
+        InfixBuilder<Tree> infixBuilder(back);
+        ostringstream infix, want, got;
+        buildFrom(postfix, builder);
+        tree.printInfixExpression(infix);
+        tree.printPostfixExpression(want);
+        buildFrom(infix.str(), infixBuilder, true);
+        back.printPostfixExpression(got);
+        same += got.str() == want.str();
+    }
+    report("same postfix", start, same, ROUND_TRIPS);
+}
+
+/* Simplifies SIMPLIFY_CHECKS small random expressions, whose constants
+ * fold into all kinds of values, and checks that the postfix printed from
+ * each reads back into a tree that prints the same. */
+void simplifyCheck()
+{
+    mt19937 rng(5);
+    long same = 0;
+
+    cout << "Simplify, " << SIMPLIFY_CHECKS << " expressions:" << endl;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < SIMPLIFY_CHECKS; i++) {
+        BET<Token> tree, back;
+        BET<Token>::Builder builder(tree);
+        BET<Token>::Builder backBuilder(back);
+        buildFrom(randomPostfix(rng, 8, 1, true), builder);
+        tree.simplify();
+        ostringstream want, got;
+        tree.printPostfixExpression(want);
+        bool built = buildFrom(want.str(), backBuilder);
+        back.printPostfixExpression(got);
+        same += built && got.str() == want.str();
+    }
+    report("simplified postfix reads back", start, same, SIMPLIFY_CHECKS);
+}
+
+void chainCheck(long levels)
+{
+    stress("left", true, levels);
+    stress("right", false, levels);
+}
+
+void reparseCheck()
+{
+    reparse<BET<Token> >("BET");
+    reparse<FlatBET>("FlatBET");
+}
+
+void roundTripCheck()
+{
+    roundTrip<BET<Token> >("BET");
+    roundTrip<FlatBET>("FlatBET");
+}
@@ -6,45 +6,247 @@
 #include <iomanip>
 #include <sstream>
 
+#include <charconv>
+#include <cstdint>
+#include <cstring>
 #include <list>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 #include "opnum.h"
+#include "lexicon.h"
 
 using namespace std;
 
+/*
+ * The text of a token, as Token::view() gives it: the lexeme the token
+ * holds or points to, or a number printed into the Lexeme itself. Valid
+ * as long as the token is.
+ */
+class Lexeme {
+public:
+    Lexeme(const char * text, size_t len) : text{text}, len{(uint32_t) len} { }
+
+    std::string_view str() const { return std::string_view(text != nullptr ? text : buf, len); }
+    bool operator== (const Lexeme & l) const { return str() == l.str(); }
+    bool operator!= (const Lexeme & l) const { return str() != l.str(); }
+
+private:
+    friend class Token;
+    Lexeme() : text{nullptr}, len{0} { }
+
+    const char * text; // the lexeme, or null if it is printed into buf
+    uint32_t len;
+    char buf[48];
+};
+
+inline std::ostream & operator<<(std::ostream &os, const Lexeme & l)
+{
+    return os << l.str();
+}
+
+/*
+ * A token in 16 bytes: its class and either the value of a number or its
+ * lexeme. A number is parsed once when the token is made and printed from
+ * its value and the number of digits it had after the point, which gives
+ * back exactly the text it was read from (the lexer has no signs and no
+ * exponents). Other lexemes of up to 8 bytes, which covers the operators
+ * and short names, are held in the token itself. Only longer lexemes,
+ * and numbers that do not print back the same (leading zeros, more than
+ * 15 digits), are kept elsewhere: where the text the token was made from
+ * is, which the caller keeps alive, or in a Lexicon the token was made
+ * with or stored in (storedIn). A tree stores the tokens of its nodes in
+ * a Lexicon of its own.
+ * Tokens are trivially copyable, so copying one never touches the heap.
+ */
 class Token {
 
 private:
-    string t_val; /* the string token */
-    int t_cls; /* the type of token */
+    static const uint8_t TEXT = 0xff;     // t_places of a token holding a lexeme rather than a value
+    static const uint8_t NO_POINT = 0xfe; // t_places of an integer
+    static const uint8_t MAX_PLACES = 24; // most digits after the point printed from a value
+    static const int MAX_DIGITS = 15;     // significant digits every double reads and prints back exactly
+    static const size_t SHORT = 8;        // longest lexeme held in the token itself
+
+    uint8_t t_cls; /* the type of token */
+    uint8_t t_real; /* 1 if the number is a double (floats, and integers too large for 64 bits) */
+    uint8_t t_places; /* digits after the point a number prints with, NO_POINT for integers; TEXT for lexemes */
+    uint32_t t_len; /* length of the lexeme, if TEXT */
+    union {
+        int64_t t_int; /* value of a SYM_INTEG token */
+        double t_num; /* value of a SYM_FLOAT token */
+        char t_short[SHORT]; /* a TEXT lexeme of up to SHORT bytes */
+        const char * t_long; /* a longer TEXT lexeme */
+    };
+
+    /*
+     * parse a number into t_int or t_num. Return true if printing the value
+     * gives val back, setting t_places.
+     */
+    bool parse(std::string_view val)
+    {
+        const char * end = val.data() + val.size();
+        if (t_cls == SYM_INTEG) {
+            auto res = from_chars(val.data(), end, t_int);
+            if (res.ec == errc() && res.ptr == end) {
+                t_places = NO_POINT;
+                return val.size() == 1 || val[0] != '0';
+            }
+        }
+        t_real = 1; // a float, or an integer too large for 64 bits
+        t_num = 0;
+        from_chars(val.data(), end, t_num);
+        size_t point = val.find('.');
+        if (t_cls != SYM_FLOAT || point == std::string_view::npos || point == 0 || val.size() - point - 1 < 1 ||
+            val.size() - point - 1 > MAX_PLACES || (val[0] == '0' && point != 1))
+            return false;
+        int digits = 0;
+        for (char c : val) {
+            if (c != '.' && (digits > 0 || c != '0'))
+                digits++;
+        }
+        t_places = (uint8_t) (val.size() - point - 1);
+        return digits <= MAX_DIGITS;
+    }
+
+    void hold(std::string_view val)
+    {
+        t_places = TEXT;
+        t_len = (uint32_t) val.size();
+        if (val.size() <= SHORT) {
+            t_int = 0;
+            if (!val.empty())
+                memcpy(t_short, val.data(), val.size());
+        } else {
+            t_long = val.data();
+        }
+    }
+
+    bool isLong() const { return t_places == TEXT && t_len > SHORT; }
+
+    std::string_view text() const { return std::string_view(t_len <= SHORT ? t_short : t_long, t_len); } //the lexeme of a TEXT token
+
+    /*
+     * the value of a number held as TEXT, parsed again: an integer, or a
+     * double if t_real.
+     */
+    int64_t textInteger() const
+    {
+        std::string_view val = text();
+        int64_t i = 0;
+        from_chars(val.data(), val.data() + val.size(), i);
+        return i;
+    }
+
+    double textNumber() const
+    {
+        std::string_view val = text();
+        double d = 0;
+        from_chars(val.data(), val.data() + val.size(), d);
+        return d;
+    }
 
 public:
-    Token ( const string & val = "", int cls = 0 )
-            : t_val { val }, t_cls { cls }
+    Token ()
+            : Token { std::string_view(), 0 }
     { }
 
-    Token ( string && val, int cls = 0)
-            : t_val { std::move( val ) }, t_cls { cls }
-    { }
+    Token ( std::string_view val, int cls = 0 )
+            : t_cls { (uint8_t) cls }, t_real { 0 }, t_places { TEXT }, t_len { 0 }, t_int { 0 }
+    {
+        if ((cls != SYM_INTEG && cls != SYM_FLOAT) || !parse(val))
+            hold(val);
+    }
+
+    // a token whose lexeme, if it is not held in the token, is stored in names
+    Token ( std::string_view val, int cls, Lexicon & names )
+            : Token { val, cls }
+    {
+        *this = storedIn(names);
+    }
+
+    // a token made from a string or a C string would point into text the
+    // caller is likely to reuse: make it from a string_view, which says the
+    // text outlives the token, or store its lexeme in a Lexicon
+    Token ( const string & val, int cls = 0 ) = delete;
+    Token ( const char * val, int cls = 0 ) = delete;
+
+    /*
+     * a copy of this token whose lexeme, if it is kept outside the token,
+     * is in names.
+     */
+    Token storedIn(Lexicon & names) const
+    {
+        Token t = *this;
+        if (isLong())
+            t.t_long = names.view(names.intern(std::string_view(t_long, t_len))).data();
+        return t;
+    }
 
-    string getValue() const { return t_val; }
+    string getValue() const { return string(view().str()); } /* copy of the lexeme; prefer view() */
     int getType () const { return t_cls; }
+    bool isInteger() const { return t_cls == SYM_INTEG && !t_real; } /* true if the value is in getInteger() */
+
+    /*
+     * the lexeme: held by the token, or printed from the value of a number.
+     */
+    Lexeme view() const
+    {
+        if (t_places == TEXT)
+            return Lexeme(text().data(), t_len);
+        Lexeme l;
+        char * end = t_real ? to_chars(l.buf, l.buf + sizeof(l.buf), t_num, chars_format::fixed, t_places).ptr
+                            : to_chars(l.buf, l.buf + sizeof(l.buf), t_int).ptr;
+        l.len = (uint32_t) (end - l.buf);
+        return l;
+    }
+
+    /*
+     * true if t is of the same class and spells the same lexeme.
+     */
+    bool sameLexeme(const Token & t) const
+    {
+        if (t_cls != t.t_cls)
+            return false;
+        if (t_places != TEXT && t.t_places != TEXT)
+            return t_places == t.t_places && t_int == t.t_int;
+        return view() == t.view();
+    }
+
+    int64_t getInteger() const
+    {
+        if (t_places == TEXT)
+            return t_real ? (int64_t) textNumber() : textInteger();
+        return t_real ? (int64_t) t_num : t_int;
+    }
+
+    double getNumber() const /* value of a number token, 0 otherwise */
+    {
+        if (t_places == TEXT && (t_cls == SYM_INTEG || t_cls == SYM_FLOAT))
+            return t_real ? textNumber() : (double) textInteger();
+        if (t_places == TEXT)
+            return 0;
+        return t_real ? t_num : (double) t_int;
+    }
 };
 
-std::ostream & operator<<(std::ostream &os, const Token & a)
+static_assert(sizeof(Token) == 16 && std::is_trivially_copyable<Token>::value,
+              "Token must stay a compact, trivially copyable value");
+
+inline std::ostream & operator<<(std::ostream &os, const Token & a)
 {
-    os << "[" << a.getType() << "]: " << a.getValue() << "; " ;
+    os << "[" << a.getType() << "]: " << a.view() << "; " ;
     return os;
 }
 
-std::ostream & operator<<(std::ostream &os, const list<Token> & a) {
+inline std::ostream & operator<<(std::ostream &os, const list<Token> & a) {
     auto itr = a.begin();
     while ( itr != a.end() ) {
         if ((*itr).getType() == SYM_ENDLN) {
             os << endl;
         } else {
-            os << (*itr).getValue() << ' ';
+            os << (*itr).view() << ' ';
         }
         itr++;
     }
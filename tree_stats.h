@@ -0,0 +1,18 @@
+#ifndef PROJ04SRC_TREE_STATS_H
+#define PROJ04SRC_TREE_STATS_H
+
+#include <cstddef>
+
+/*
+ * Shape of an expression tree, as returned by BET::stats and
+ * FlatBET::stats. An empty tree has size 0, no leaves, depth -1 and
+ * breadth 0.
+ */
+struct TreeStats {
+    size_t size = 0;   // number of nodes
+    int leaves = 0;    // number of nodes without children
+    int depth = -1;    // level of the deepest node, the root being level 0
+    int breadth = 0;   // number of nodes on the fullest level
+};
+
+#endif //PROJ04SRC_TREE_STATS_H
@@ -0,0 +1,136 @@
+#ifndef PROJ04SRC_WORK_POOL_H
+#define PROJ04SRC_WORK_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed set of worker threads running submitted tasks, with work stealing.
+ *
+ * Every worker has a queue of its own. submit() deals tasks to the queues
+ * in turn; a worker takes tasks from the front of its own queue and, once
+ * that is empty, steals from the back of the others, so a worker stuck on
+ * a long task does not hold up the tasks queued behind it.
+ *
+ * Tasks run in no particular order. The destructor runs every task still
+ * queued, then joins the workers.
+ */
+class WorkPool {
+public:
+    explicit WorkPool(unsigned threads)
+            : pending{0}, stopping{false}, nextQueue{0}
+    {
+        if (threads == 0)
+            threads = 1;
+        for (unsigned i = 0; i < threads; i++)
+            queues.emplace_back(new Queue);
+        for (unsigned i = 0; i < threads; i++)
+            workers.emplace_back([this, i] { work(i); });
+    }
+
+    ~WorkPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(idleLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto & w : workers)
+            w.join();
+    }
+
+    WorkPool(const WorkPool &) = delete;
+    WorkPool & operator= (const WorkPool &) = delete;
+
+    /*
+     * queue task to be run by one of the workers.
+     */
+    void submit(std::function<void()> task)
+    {
+        Queue & q = *queues[nextQueue];
+        nextQueue = (nextQueue + 1) % queues.size();
+        {
+            std::lock_guard<std::mutex> guard(q.lock);
+            q.tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> guard(idleLock);
+            pending++;
+        }
+        wake.notify_one();
+    }
+
+    unsigned threads() const { return (unsigned) workers.size(); } // number of workers
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<std::function<void()> > tasks;
+    };
+
+    /*
+     * run tasks until the pool is destroyed and no task is left.
+     */
+    void work(unsigned self)
+    {
+        std::function<void()> task;
+        for (;;) {
+            if (take(self, task)) {
+                {
+                    std::lock_guard<std::mutex> guard(idleLock);
+                    pending--;
+                }
+                task();
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(idleLock);
+            wake.wait(guard, [this] { return pending > 0 || stopping; });
+            if (stopping && pending <= 0)
+                return;
+        }
+    }
+
+    /*
+     * move the next task for worker self into task: the oldest of its own
+     * queue, or else the newest of another worker's. Return false if every
+     * queue is empty.
+     */
+    bool take(unsigned self, std::function<void()> & task)
+    {
+        {
+            Queue & own = *queues[self];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.front());
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); i++) {
+            Queue & victim = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<Queue> > queues; // one per worker
+    std::vector<std::thread> workers;
+    std::mutex idleLock;                          // guards pending and stopping
+    std::condition_variable wake;                 // signalled when a task is queued or the pool stops
+    long pending;                                 // tasks submitted and not yet taken
+    bool stopping;                                // true once the destructor runs
+    size_t nextQueue;                             // queue the next submitted task goes to (submit is called from one thread)
+};
+
+#endif //PROJ04SRC_WORK_POOL_H